@@ -75,17 +75,27 @@
 #define SYS_STATE_MOVING		3	/* */
 #define SYS_STATE_ERROR			9	/* */
 
+#define SERIAL_RX_BYTES_PER_PASS	16	/* Max bytes parsed per pass, so the control task stays on time */
+
  /*******************************************************************************
   Function prototypes
   *******************************************************************************/
 void(*resetFunc)(void) = 0; //declare reset function at address 0
 
+//Tasks run by the scheduler
+void taskControl(void);
+#ifdef USE_WAV_GEN
+void taskWaveGen(void);
+#endif /* USE_WAV_GEN */
+void taskSerial(void);
+
 //Menu Commands (without any owners)
 #ifdef MAIN_DEBUG
 #ifdef CONSOLE_MENU
 void menuTime(void);
 void menuReset(void);
 void menuVersion(void);
+void menuTasks(void);
 #endif /* CONSOLE_MENU */
 #endif /* MAIN_DEBUG */
 
@@ -102,10 +112,22 @@ void menuVersion(void);
 ST_CONSOLE_LIST_ITEM devMenuItem_time = { NULL, "time", menuTime, "Returns the system time" };
 ST_CONSOLE_LIST_ITEM devMenuItem_reset = { NULL, "reset", menuReset, "Resets the system" };
 ST_CONSOLE_LIST_ITEM devMenuItem_version = { NULL, "version", menuVersion, "Display firmware version" };
+ST_CONSOLE_LIST_ITEM devMenuItem_tasks = { NULL, "tasks", menuTasks, "Task run times (\"tasks reset\" to clear)" };
 #endif /* CONSOLE_MENU */
 #endif /* MAIN_DEBUG */
 //int SystemState;		/* Movement State Machine variable */
 
+//The task table... in priority order (highest first)
+ST_TASK taskTable[] = {
+	//Name		Task							Budget (us)
+	{"timers",	timerUtils::msTimerService,		500,	0, 0},
+	{"control",	taskControl,					3000,	0, 0},
+#ifdef USE_WAV_GEN
+	{"wavegen",	taskWaveGen,					3000,	0, 0},
+#endif /* USE_WAV_GEN */
+	{"serial",	taskSerial,						5000,	0, 0},
+};
+
 const char BuildTimeData[] = { __TIME__ " " __DATE__ }; /* Used in our startup Banner*/
 
 
@@ -160,8 +182,11 @@ void setup() {
 	devConsole::addMenuItem(&devMenuItem_reset);
 	devConsole::addMenuItem(&devMenuItem_time);
 	devConsole::addMenuItem(&devMenuItem_version);
+	devConsole::addMenuItem(&devMenuItem_tasks);
 #endif /* MAIN_DEBUG */
 
+	timerUtils::taskInit(taskTable, sizeof(taskTable)/sizeof(ST_TASK));
+
 
 #ifdef CONSOLE_MENU
 	//Set the print traces we want...
@@ -186,22 +211,45 @@ void setup() {
 void loop() {
 	// put your main code here, to run repeatedly:
 
-	//Check for anything coming in on the Serial Port and process it
-#ifdef CONSOLE_MENU
-	devConsole::Read();
-#else
-	devComms::Read();
-#endif
+	//Run every task in the table (see taskTable)
+	timerUtils::taskService();
+}
 
-	//Do the Position controlling (if enabled and required).
+/*******************************************************************************
+
+ Do the Position controlling (if enabled and required).
+
+ *******************************************************************************/
+void taskControl(void)
+{
 	appPidControl::ControlStateHandler();
+}
 
-	//We only consider using the waveform generator if the PID is not active.
+/*******************************************************************************
+
+ We only consider using the waveform generator if the PID is not active.
+
+ *******************************************************************************/
 #ifdef USE_WAV_GEN
-	else if (appWaveGen::Enabled()) {
-	appWaveGen::Process();
-	}
+void taskWaveGen(void)
+{
+	if ((!appPidControl::Enabled()) && (appWaveGen::Enabled()))
+		appWaveGen::Process();
+}
 #endif /* USE_WAV_GEN */
+
+/*******************************************************************************
+
+ Check for anything coming in on the Serial Port and process it
+
+ *******************************************************************************/
+void taskSerial(void)
+{
+#ifdef CONSOLE_MENU
+	devConsole::Read(SERIAL_RX_BYTES_PER_PASS);
+#else
+	devComms::Read(SERIAL_RX_BYTES_PER_PASS);
+#endif
 }
 
 /*******************************************************************************
@@ -225,6 +273,27 @@ void menuTime(void)
 	PrintF("Running for %lu s\n", ((long)millis() / 1000));
 }
 
+/*******************************************************************************
+
+ Prints the run time statistics of the tasks.
+
+ *******************************************************************************/
+void menuTasks(void)
+{
+	ST_TASK *task;
+	char *paramStr = devConsole::getParam(0);
+
+	if ((paramStr) && (strcasecmp(paramStr, "reset") == NULL))
+		timerUtils::taskStatsReset();
+
+	PrintF(" Task     Budget  MaxRun  Overruns\n");
+	for (byte i = 0; i < timerUtils::taskCount(); i++)
+	{
+		task = timerUtils::taskGet(i);
+		PrintF(" %-8s % 6u % 7u % 9u\n", task->Name, task->Budget_us, task->MaxRun_us, task->Overruns);
+	}
+}
+
 /*******************************************************************************
 
  Resets the system
@@ -42,6 +42,7 @@ includes
 #include "stdUtils.h"
 #include "timerUtils.h"
 #include "devMotorControl.h"
+#include "appTrajectory.h"
 #ifdef CONSOLE_MENU
 	#include "devConsole.h"
 #else
@@ -53,8 +54,44 @@ local defines
  *******************************************************************************/
 //#define PID_CSV_STREAM
 
+#define PID_TRACK_GAIN		4.0		/* deg/s added for every deg we are behind the planned move */
+#define PID_VEL_PERIOD_US	1000ul	/* The inner velocity loop runs at 1kHz... */
+#define PID_VEL_PERIOD		(PID_VEL_PERIOD_US / 1000000.0)	/* ...every this many s */
+
+#define TUNE_RELAY_DEF		5.0		/* deg/s, the default relay speed of the autotune */
+#define TUNE_HYSTERESIS		0.5		/* deg/s either side of the centre before the relay switches (encoder noise) */
+#define TUNE_PULL_GAIN		0.5		/* deg/s the centre moves for every deg we are away from the start */
+#define TUNE_POS_RANGE		5.0		/* deg, we give up if the relay takes us further than this from the start... */
+#define TUNE_TIMEOUT_MS		20000ul	/* ...or if it takes longer than this */
+#define TUNE_CYCLES_SKIP	2		/* Relay cycles we leave to settle... */
+#define TUNE_CYCLES			4		/* ...and the number we average over */
+
+/* The braking curve sqrt(2 x MaxAccel x posError) is kept as a table of
+ * sqrt(2 x posError) in flash over one stretch of position errors (64 to 256
+ * deg), scaled by sqrt(MaxAccel). Since sqrt(4x) = 2 sqrt(x), any other error is
+ * shifted into this stretch 2 bits at a time, and the speed shifted back 1 bit
+ * for each. */
+#define BRAKE_TABLE_SEGS	48				/* Segments in the braking table (4 deg each) */
+#define BRAKE_ERR_MIN		(1ul << 22)		/* 64 deg in Q16.16, the start of the table */
+#define BRAKE_ERR_MAX		(1ul << 24)		/* 256 deg, the end of it */
+#define BRAKE_SEG_SHIFT		18				/* 4 deg in Q16.16 */
+#define BRAKE_FRAC_SHIFT	10				/* Interpolation steps per segment (bits) */
+
+#ifdef PID_FIXED_POINT
+	#define PID_Q16_PER_COUNT	((long)(MOTOR_POS_INCREMENT_DEG * Q16_ONE))	/* One encoder count (deg), Q16.16 */
+	#define PID_Q28_PER_TICK	((long)(268435456.0 * Q16_ONE / (1000000.0 * TICKS_PER_US)))	/* One tick (s) in Q4.28, itself in Q16.16 */
+	#define PID_TICKS_PER_S_Q8	(1000000ul * TICKS_PER_US * 256ul)
+	#define PID_DT_TICKS_MIN	(100ul * TICKS_PER_US)		/* Keeps 1/dt in range */
+	#define PID_DT_TICKS_MAX	(4000000ul * TICKS_PER_US)	/* Keeps dt (Q4.28) in range */
+	#define PID_VEL_DT_Q28		((long)(PID_VEL_PERIOD * 268435456.0))	/* One inner loop period (s), Q4.28 */
+#endif /* PID_FIXED_POINT */
+
 #ifdef PID_CSV_STREAM
+  #ifdef PID_FIXED_POINT
+	#define PrintCsvHeaders()	iPrintF(trPIDCTRL, "[PID],Time,PosErr,Bound,SpdErr,spdOut\n")
+  #else
 	#define PrintCsvHeaders()	iPrintF(trPIDCTRL, "[PID],Time,Pos,PosErr,Spd,dSpd,eSpd,aSpd,Bound,SpdErr,spdOut1,spdOut2,spdOut,deltaSpd\n")
+  #endif /* PID_FIXED_POINT */
 #endif /* #ifdef PID_CSV_STREAM */
 
 /*******************************************************************************
@@ -64,14 +101,14 @@ local variables
 ST_CONSOLE_LIST_ITEM devMenuItem_PIDCmds = {NULL, "pid", 	 	 appPidControl::menuCmd,	"Provides access to the PID control variables"};
 #endif /* CONSOLE_MENU */
 //ST_PID pidControl;
-ST_MS_TIMER pidTimer;
 
 
 #ifndef PID_CSV_STREAM
 	ST_MS_TIMER pidUpdatePosTimer;
+	void pidPrintPosition(void);
 #endif /* #ifdef PID_CSV_STREAM */
 
-const ST_PID pidControlDefault = {
+const ST_PID pidControlDefault PROGMEM = {
 		80.0,	// Kp
 		0.4, 	// Ki
 		2.0, 	// Kd
@@ -90,12 +127,77 @@ const ST_PID pidControlDefault = {
 		0.0, 	// startPos
 		0l, 	// startTime
 		false,	// aiming
+		0.0, 	// TimeToTarget
+		0.0, 	// maxJerk
+		0.0, 	// Kff
+		0.0, 	// Kaff
+		0.0, 	// Kvp
+		0.0, 	// Kvi
 };
 bool appPidControl_initOK = false;
 
+#ifdef PID_FIXED_POINT
+ST_PID_Q16 pidFixed;
+#endif /* PID_FIXED_POINT */
+
+/* sqrt(2 x posError) (Q5.11) for posError = 64, 68 ... 256 deg */
+const unsigned int brakeTable[BRAKE_TABLE_SEGS + 1] PROGMEM = {
+	23170, 23884, 24576, 25249, 25905, 26545, 27170, 27780,
+	28378, 28963, 29537, 30099, 30652, 31194, 31727, 32252,
+	32768, 33276, 33776, 34270, 34756, 35235, 35708, 36175,
+	36636, 37091, 37540, 37985, 38424, 38858, 39287, 39712,
+	40132, 40548, 40960, 41368, 41771, 42171, 42567, 42959,
+	43348, 43733, 44115, 44494, 44869, 45242, 45611, 45977,
+	46341
+};
+long brakeScale;	/* sqrt(pidSettings.MaxAccel), Q16.16 (see BrakeTableBuild) */
+
+float pidLegSpeed = 0.0;	/* The max speed (deg/s) of the move to pidSettings.Target, 0 = pidSettings.MaxSpeed */
+float pidStopPos;			/* Where we must come to rest (deg)... past the target when we blend into the waypoints after it */
+float pidFeedFwd;			/* The feedforward part of pidSettings.Speed (deg/s) */
+float pidVelInt;			/* The integral of the inner velocity loop's speed error (deg) */
+float pidVelOut;			/* The last output of the inner velocity loop (deg/s) */
+bool pidVelOn = false;		/* The inner velocity loop ran last time (see pidVelStep) */
+
+byte pidWrapPolicy = WRAP_SHORTEST;	/* See ResolveTarget() */
+float pidTravel = 0.0;				/* How far (deg, + or -) the last target resolved is from where we were */
+
+/* {Kc/Ku, Ti/Tu} of the PI tuning rules, indexed by TUNE_RULE_xxx */
+const float tuneRules[TUNE_RULE_MAX + 1][2] PROGMEM = {
+		{0.45,		1.0/1.2},	// Ziegler-Nichols
+		{1.0/3.2,	2.2},		// Tyreus-Luyben
+};
+
+/* The breakpoints of the gain schedule until they are set (deg/s) */
+const float gsSpeedDefault[GS_POINTS] PROGMEM = {0.0, 2.0, 9.0, MOTOR_SPD_ABS_MAX};
+
+float tuneStartPos;				/* Where (deg) the autotune started */
+unsigned long tuneStartMs;		/* millis() at the start */
+unsigned long tuneLastTick;		/* timerUtils::tickNow() of the last upward switch of the relay */
+unsigned long tunePeriodSum;	/* Ticks of the cycles measured so far */
+float tuneAmpSum;				/* Half the peak to peak speed (deg/s) of the cycles measured so far */
+float tuneVelMax;				/* The highest and lowest encoder speed (deg/s) of this cycle */
+float tuneVelMin;
+signed char tuneRelay;			/* +1 or -1, the side the relay is on */
+byte tuneCycles;				/* Upward switches so far */
+
 /*******************************************************************************
 local functions
  *******************************************************************************/
+long brakeSpeed_q16(long posError);
+void pidPlanMove(float startPos, float startVel);
+bool pidNextWaypoint(float startPos, float startVel);
+bool pidCascaded(void);
+void pidVelStep(float encSpeed, byte ticks);
+void pidTuneStep(void);
+#ifndef PID_FIXED_POINT
+void pidScheduleGains(float speed, ST_PID_GAINS * gains);
+#endif /* PID_FIXED_POINT */
+void pidTuneEnd(bool measured);
+#ifdef PID_FIXED_POINT
+float pidStep_q16(long spdTarget, long spdFf, unsigned long elapsed);
+void pidScheduleGains_q16(long speed, long * gains);
+#endif /* PID_FIXED_POINT */
 
 /*******************************************************************************
 
@@ -111,14 +213,29 @@ bool appPidControl::Init(void)
 		devConsole::addMenuItem(&devMenuItem_PIDCmds);
 #endif /* CONSOLE_MENU */
 
-		timerUtils::msTimerStop(&pidTimer);
+		timerUtils::usTickStop(&timerUtils::ctlTick);
+		timerUtils::usTickStop(&timerUtils::velTick);
 #ifndef PID_CSV_STREAM
-		timerUtils::msTimerStop(&pidUpdatePosTimer);
+		timerUtils::msTimerRemove(&pidUpdatePosTimer);
 #endif /* #ifdef PID_CSV_STREAM */
 		//pidControl.Enable = true;
-		memcpy(&pidSettings, &pidControlDefault, sizeof(ST_PID));
+		memcpy_P(&pidSettings, &pidControlDefault, sizeof(ST_PID));
 		//When we start up we can read the current position of the encoder and return to zero if we are not there.
 		pidSettings.Target = 0.0;
+		autoTune.Relay = TUNE_RELAY_DEF;
+		autoTune.Rule = TUNE_RULE_TL;
+		//The schedule starts out flat, with the default gains everywhere
+		gainSchedule.Enable = 0;
+		for (byte i = 0; i < GS_POINTS; i++)
+		{
+			gainSchedule.Speed[i] = pgm_read_float(&gsSpeedDefault[i]);
+			gainSchedule.Gains[GS_DIR_POS][i].Kp = pidSettings.Kp;
+			gainSchedule.Gains[GS_DIR_POS][i].Ki = pidSettings.Ki;
+			gainSchedule.Gains[GS_DIR_POS][i].Kd = pidSettings.Kd;
+			gainSchedule.Gains[GS_DIR_NEG][i] = gainSchedule.Gains[GS_DIR_POS][i];
+		}
+		BrakeTableBuild();
+		UpdateSettings();
 		//We are very dependant on the Motor Controller working properly.
 		appPidControl_initOK |= devMotorControl::Init();
 
@@ -143,7 +260,14 @@ Starts The PID process
  *******************************************************************************/
 void appPidControl::Start(void)
 {
-	timerUtils::msTimerStart(&pidTimer, (unsigned long)(pidSettings.Period * 1000.0));
+	UpdateSettings();
+	//The control steps are timed by Timer2 (see timerUtils::usTickStart)
+	timerUtils::usTickStart(&timerUtils::ctlTick, (unsigned long)(pidSettings.Period * 1000000.0));
+	timerUtils::usTickStart(&timerUtils::velTick, PID_VEL_PERIOD_US);
+	ctlStats.LastTick = timerUtils::tickNow();
+	ctlStats.dt = pidSettings.Period;
+	ctlStats.Jitter = 0.0;
+	ctlStats.Overruns = 0;
 	pidSettings.startPos = devMotorControl::GetPosition();
 	pidSettings.startTime = millis();
 	pidSettings.aiming = true;
@@ -151,10 +275,20 @@ void appPidControl::Start(void)
 	pidSettings.intError = 0;
 	pidSettings.derError = 0;
 	pidSettings.error = 0;
+	pidFeedFwd = 0.0;
+	pidVelOn = false;		//The inner loop starts again (see pidVelStep)
+	//Plan the whole move up front (see appTrajectory)
+	pidPlanMove(pidSettings.startPos, pidSettings.Speed);
+#ifdef PID_FIXED_POINT
+	pidFixed.Speed = stdUtils::q16FromFloat(pidSettings.Speed);
+	pidFixed.intError = 0;
+	pidFixed.error = 0;
+	pidFixed.FeedFwd = 0;
+#endif /* PID_FIXED_POINT */
 #ifdef PID_CSV_STREAM
 	PrintCsvHeaders();
 #else
-	timerUtils::msTimerStart(&pidUpdatePosTimer, (unsigned long)(500.0));
+	timerUtils::msTimerAdd(&pidUpdatePosTimer, 500ul, pidPrintPosition);
 #endif /* #ifdef PID_CSV_STREAM */
 	stdUtils::SetStatus(statusPID_BUSY);
 	stdUtils::ClearStatus(statusPID_DONE);
@@ -162,6 +296,45 @@ void appPidControl::Start(void)
 }
 
 
+/*******************************************************************************
+
+Moves on to the new pidSettings.Target. If we are moving already, the move is
+replanned from where we are and the speed we are set to, and the controller
+carries on as it is (no new Start(), so no jump in speed and the integral
+error is kept). This is what lets the host send a new target many times a
+second without the motion stuttering.
+
+ *******************************************************************************/
+void appPidControl::Retarget(void)
+{
+	if (!pidSettings.Enable)
+	{
+		Start();
+		return;
+	}
+
+	//The new target replaces any waypoints (or tracking) still to come
+	appTrajectory::QueueClear();
+
+	pidSettings.Position = devMotorControl::GetPosition();
+	pidSettings.aiming = true;
+	stdUtils::SetStatus(statusPID_BUSY);
+	stdUtils::ClearStatus(statusPID_DONE);
+	pidPlanMove(pidSettings.Position, pidSettings.Speed);
+}
+
+/*******************************************************************************
+
+Prints our position while we are moving (pidUpdatePosTimer callback)
+
+ *******************************************************************************/
+#ifndef PID_CSV_STREAM
+void pidPrintPosition(void)
+{
+	iPrintF(trPIDCTRL,  "[PID] Position: %s\n",			stdUtils::floatToStr(appPidControl::pidSettings.Position, 3));
+}
+#endif /* #ifdef PID_CSV_STREAM */
+
 /*******************************************************************************
 
 Starts The PID process
@@ -169,20 +342,211 @@ Starts The PID process
  *******************************************************************************/
 void appPidControl::Stop(void)
 {
+	AutoTuneAbort();
 	pidSettings.aiming = false;
 	pidSettings.Speed = devMotorControl::GetSpeed_DAC();
 	stdUtils::ClearStatus(statusPID_BUSY);
 	stdUtils::ClearStatus(statusPID_DONE);
 	pidSettings.Enable = false;
+	appTrajectory::Stop();
+	appTrajectory::QueueClear();
+	pidLegSpeed = 0.0;
+#ifndef PID_CSV_STREAM
+	timerUtils::msTimerRemove(&pidUpdatePosTimer);
+#endif /* #ifdef PID_CSV_STREAM */
 	devMotorControl::Stop();
 }
 
 /*******************************************************************************
 
-Starts the calibration routine
+Plans the move to pidSettings.Target from "startPos" (deg), going at
+"startVel" (deg/s). If the next waypoint in the queue is further along the
+same way, we don't stop at the target but pass it as fast as the next move
+allows (it may be the last, so we must be able to stop at it).
 
  *******************************************************************************/
-bool appPidControl::GotoPos(float newPos)
+void pidPlanMove(float startPos, float startVel)
+{
+ST_TRAJ_WAYPOINT next;
+float dir = sign_f(appPidControl::pidSettings.Target - startPos);
+float legSpeed;
+float endSpeed = 0.0;
+float nextSpeed;
+byte i;
+
+	legSpeed = appPidControl::pidSettings.MaxSpeed;
+	if ((pidLegSpeed > 0.0) && (pidLegSpeed < legSpeed))
+		legSpeed = pidLegSpeed;
+
+	//We only come to rest where the waypoints turn back (or run out)
+	pidStopPos = appPidControl::pidSettings.Target;
+	for (i = 0; appTrajectory::QueuePeek(i, &next); i++)
+	{
+		if ((next.Pos == pidStopPos) || (sign_f(next.Pos - pidStopPos) != dir))
+			break;
+
+		if (i == 0)
+		{
+			nextSpeed = appPidControl::pidSettings.MaxSpeed;
+			if ((next.Speed > 0.0) && (next.Speed < nextSpeed))
+				nextSpeed = next.Speed;
+
+			endSpeed = appTrajectory::StopSpeed(abs(next.Pos - pidStopPos),
+						appPidControl::pidSettings.MaxAccel, appPidControl::pidSettings.MaxJerk);
+			if (endSpeed > nextSpeed)
+				endSpeed = nextSpeed;
+			if (endSpeed > legSpeed)
+				endSpeed = legSpeed;
+		}
+		pidStopPos = next.Pos;
+	}
+#ifdef PID_FIXED_POINT
+	pidFixed.StopPos = stdUtils::q16FromFloat(pidStopPos);
+#endif /* PID_FIXED_POINT */
+
+	appTrajectory::PlanMove(startPos, startVel, appPidControl::pidSettings.Target, legSpeed,
+			appPidControl::pidSettings.MaxAccel, appPidControl::pidSettings.MaxJerk, endSpeed);
+}
+
+/*******************************************************************************
+
+Takes the next waypoint off the queue and plans the move to it from
+"startPos" (deg), going at "startVel" (deg/s).
+Returns false if there are no more waypoints.
+
+ *******************************************************************************/
+bool pidNextWaypoint(float startPos, float startVel)
+{
+ST_TRAJ_WAYPOINT point;
+
+	if (!appTrajectory::QueueTake(&point))
+		return false;
+
+	appPidControl::pidSettings.Target = point.Pos;
+	pidLegSpeed = point.Speed;
+	pidPlanMove(startPos, startVel);
+
+	return true;
+}
+
+/*******************************************************************************
+
+Sets the period (s) of the control step. The control tick only picks it up in
+Start(), so it cannot be changed while we are moving (ctlStats would measure
+the steps against a period that is not running).
+Returns the period now in use.
+
+ *******************************************************************************/
+float appPidControl::SetPeriod(float period)
+{
+	if (pidSettings.Enable)
+		iPrintF(trPIDCTRL | trALWAYS, "[PID]Cannot change the period while moving\n");
+	else
+		stdUtils::setFloatParam(&pidSettings.Period, period, PID_PERIOD_MIN, 1.0);
+
+	return pidSettings.Period;
+}
+
+/*******************************************************************************
+
+Must be called every time one of the pidSettings is changed. Converts them for
+the fixed point control step (does nothing without PID_FIXED_POINT).
+
+ *******************************************************************************/
+void appPidControl::UpdateSettings(void)
+{
+#ifdef PID_FIXED_POINT
+	pidFixed.Kp = stdUtils::q16FromFloat(pidSettings.Kp);
+	pidFixed.Ki = stdUtils::q16FromFloat(pidSettings.Ki);
+	pidFixed.Kd = stdUtils::q16FromFloat(pidSettings.Kd);
+	pidFixed.bias = stdUtils::q16FromFloat(pidSettings.bias);
+	pidFixed.MaxAccel = stdUtils::q16FromFloat(pidSettings.MaxAccel);
+	pidFixed.MaxSpeed = stdUtils::q16FromFloat(pidSettings.MaxSpeed);
+	pidFixed.Kff = stdUtils::q16FromFloat(pidSettings.Kff);
+	pidFixed.Kaff = stdUtils::q16FromFloat(pidSettings.Kaff);
+	pidFixed.Kvp = stdUtils::q16FromFloat(pidSettings.Kvp);
+	pidFixed.Kvi = stdUtils::q16FromFloat(pidSettings.Kvi);
+
+	for (byte i = 0; i < GS_POINTS; i++)
+	{
+		pidFixed.GsSpeed[i] = stdUtils::q16FromFloat(gainSchedule.Speed[i]);
+		if (i > 0)
+			pidFixed.GsInvStep[i - 1] = (gainSchedule.Speed[i] > gainSchedule.Speed[i - 1])?
+					stdUtils::q16FromFloat(1.0 / (gainSchedule.Speed[i] - gainSchedule.Speed[i - 1])) : 0;
+		for (byte dir = GS_DIR_POS; dir <= GS_DIR_NEG; dir++)
+		{
+			pidFixed.GsGains[dir][i][0] = stdUtils::q16FromFloat(gainSchedule.Gains[dir][i].Kp);
+			pidFixed.GsGains[dir][i][1] = stdUtils::q16FromFloat(gainSchedule.Gains[dir][i].Ki);
+			pidFixed.GsGains[dir][i][2] = stdUtils::q16FromFloat(gainSchedule.Gains[dir][i].Kd);
+		}
+	}
+#endif /* PID_FIXED_POINT */
+}
+
+/*******************************************************************************
+
+Scales the braking table for pidSettings.MaxAccel. This is the only place the
+PID takes a square root, so it must be called every time MaxAccel is changed.
+
+ *******************************************************************************/
+void appPidControl::BrakeTableBuild(void)
+{
+	brakeScale = stdUtils::q16FromFloat(sqrtf(pidSettings.MaxAccel));
+}
+
+/*******************************************************************************
+
+Looks up the fastest we can go (deg/s, Q16.16) at "posError" (deg, Q16.16) and
+still stop at the target with pidSettings.MaxAccel... the same sign as posError.
+
+ *******************************************************************************/
+long brakeSpeed_q16(long posError)
+{
+unsigned long err = (posError < 0)? -(unsigned long)posError : (unsigned long)posError;
+unsigned long frac;
+long speed;
+unsigned int lo, hi;
+int shift = 0;
+byte seg;
+
+	if (err == 0)
+		return 0;
+
+	//Shift the error into the table, 2 bits at a time
+	while (err < BRAKE_ERR_MIN)
+	{
+		err <<= 2;
+		shift--;
+	}
+	while (err >= BRAKE_ERR_MAX)
+	{
+		err >>= 2;
+		shift++;
+	}
+
+	seg = (byte)((err - BRAKE_ERR_MIN) >> BRAKE_SEG_SHIFT);
+	frac = (err >> (BRAKE_SEG_SHIFT - BRAKE_FRAC_SHIFT)) & ((1ul << BRAKE_FRAC_SHIFT) - 1);
+
+	//The curve only ever goes up, so the difference is positive
+	lo = pgm_read_word(&brakeTable[seg]);
+	hi = pgm_read_word(&brakeTable[seg + 1]);
+	speed = (long)lo + (long)((((unsigned long)(hi - lo)) * frac) >> BRAKE_FRAC_SHIFT);
+	speed = stdUtils::mulShift(speed, brakeScale, 11);		/* Q5.11 x Q16.16 to Q16.16 */
+
+	speed = (shift >= 0)? (speed << shift) : (speed >> -shift);
+
+	return (posError < 0)? -speed : speed;
+}
+
+/*******************************************************************************
+
+Moves to "newPos" (deg). If "resolve", it is an azimuth and we go to the turn
+of it the wrap policy picks (see ResolveTarget). Otherwise (a relative move,
+say) we go to exactly "newPos", so the dish never turns the other way round.
+Returns false if we are busy calibrating, or it is out of range.
+
+ *******************************************************************************/
+bool appPidControl::GotoPos(float newPos, bool resolve)
 {
 int retVal;
 
@@ -194,11 +558,184 @@ int retVal;
 	if (stdUtils::setFloatParam(&pidSettings.Target, newPos, MOTOR_POS_WRAP_MIN, MOTOR_POS_WRAP_MAX) != 0)
 		return false;
 
-	pidSettings.Target = newPos;
-	Start();
+	if (resolve)
+		pidSettings.Target = ResolveTarget(newPos);
+	else
+		pidTravel = newPos - devMotorControl::GetPosition();
+	pidLegSpeed = 0.0;
+	Retarget();
+
+	return true;
+}
+
+/*******************************************************************************
+
+Returns the turn of "azimuth" (deg) to drive to, according to the wrap policy
+(see WRAP_xxx), and remembers the travel to it from where we are (GetTravel).
+
+ *******************************************************************************/
+float appPidControl::ResolveTarget(float azimuth)
+{
+float from = devMotorControl::GetPosition();
+float best = azimuth;
+float cand;
+
+	if ((pidWrapPolicy != WRAP_LITERAL) && (azimuth >= -180.0) && (azimuth <= 180.0))
+	{
+		//The lowest turn within the wrap limits...
+		cand = azimuth;
+		while ((cand - 360.0) >= MOTOR_POS_WRAP_MIN)
+			cand -= 360.0;
+
+		//...and then every one above it. Equal travel goes to the least wrap.
+		for (; cand <= MOTOR_POS_WRAP_MAX; cand += 360.0)
+		{
+			if ((pidWrapPolicy == WRAP_SHORTEST) && (abs(cand - from) != abs(best - from)))
+			{
+				if (abs(cand - from) < abs(best - from))
+					best = cand;
+			}
+			else if (abs(cand) < abs(best))
+				best = cand;
+		}
+	}
+
+	pidTravel = best - from;
+
+	return best;
+}
+
+/*******************************************************************************
+
+Sets the wrap policy of ResolveTarget() (WRAP_xxx)
+Returns the new setting
+
+ *******************************************************************************/
+byte appPidControl::SetWrapPolicy(byte policy)
+{
+	if (policy <= WRAP_CENTRE)
+		pidWrapPolicy = policy;
+
+	return pidWrapPolicy;
+}
+
+/*******************************************************************************
+
+Returns the wrap policy of ResolveTarget() (WRAP_xxx)
+
+ *******************************************************************************/
+byte appPidControl::GetWrapPolicy(void)
+{
+	return pidWrapPolicy;
+}
+
+/*******************************************************************************
+
+How far (deg) the last target we resolved is from where we were at the time...
+the sign is the direction we go.
+
+ *******************************************************************************/
+float appPidControl::GetTravel(void)
+{
+	return pidTravel;
+}
+
+/*******************************************************************************
+
+Starts moving through the waypoint queue (see appTrajectory::QueueAdd). If we
+are moving already, the control step takes the waypoints as it gets to them.
+Returns false if we are busy calibrating.
+
+ *******************************************************************************/
+bool appPidControl::QueueStart(void)
+{
+ST_TRAJ_WAYPOINT point;
+
+	//Are we busy calibrating?
+	if (ControlState != stateIDLE)
+		return false;
+
+	if ((!pidSettings.Enable) && (appTrajectory::QueueTake(&point)))
+	{
+		pidSettings.Target = point.Pos;
+		pidLegSpeed = point.Speed;
+		Start();
+	}
 
 	return true;
 }
+
+/*******************************************************************************
+
+Starts tracking the time-tagged samples given to TrackAdd(), from where we are
+now (see appTrajectory::TrackStart).
+Returns false if we are busy calibrating.
+
+ *******************************************************************************/
+bool appPidControl::TrackStart(void)
+{
+	//Are we busy calibrating?
+	if (ControlState != stateIDLE)
+		return false;
+
+	appTrajectory::QueueClear();
+	pidSettings.Target = devMotorControl::GetPosition();
+	if (!pidSettings.Enable)
+	{
+		pidLegSpeed = 0.0;
+		Start();
+	}
+
+	//Until the samples come we stay here... and never go past the last one
+	pidStopPos = pidSettings.Target;
+#ifdef PID_FIXED_POINT
+	pidFixed.StopPos = stdUtils::q16FromFloat(pidStopPos);
+#endif /* PID_FIXED_POINT */
+	appTrajectory::TrackStart(pidSettings.Target);
+
+	return true;
+}
+
+/*******************************************************************************
+
+Adds the sample that we must be at "pos" (deg) at "t" (s since TrackStart).
+Returns false if we are not tracking, or the sample was not taken.
+
+ *******************************************************************************/
+bool appPidControl::TrackAdd(float t, float pos)
+{
+	if ((!appTrajectory::Tracking()) || (!appTrajectory::TrackAdd(t, pos)))
+		return false;
+
+	pidSettings.Target = pos;
+	pidStopPos = pos;
+#ifdef PID_FIXED_POINT
+	pidFixed.StopPos = stdUtils::q16FromFloat(pidStopPos);
+#endif /* PID_FIXED_POINT */
+
+	return true;
+}
+
+/*******************************************************************************
+
+Stops tracking: we come to rest as soon as we can (coming back to where the
+reference was if we can't stop in time) and the PID finishes as for any move.
+
+ *******************************************************************************/
+void appPidControl::TrackStop(void)
+{
+ST_TRAJ_POINT ref;
+
+	if (!appTrajectory::Tracking())
+		return;
+
+	appTrajectory::Next(0, &ref);
+	appTrajectory::TrackStop();
+
+	pidSettings.Target = ref.Pos;
+	pidLegSpeed = 0.0;
+	pidPlanMove(ref.Pos, ref.Vel);
+}
 /*******************************************************************************
 
 The PID process... needs to be called repeatedly as often as possible.
@@ -209,12 +746,28 @@ bool appPidControl::PID_Process(void)
 float posError;
 float spdError;
 float spdBound;
+float spdFeedFwd;
 float spdOutput;
-float dacSpeed;
 float encSpeed;
+#ifdef PID_CSV_STREAM
+float dacSpeed;
 float avgSpeed;
+#endif /* PID_CSV_STREAM */
 float thisAccel;
 float timeTaken;
+float dt;
+unsigned long now_tick;
+unsigned long elapsed;
+long spdTarget;
+long spdTrack;
+long spdFf = 0;
+byte ticks;
+bool tracking;
+ST_ENC_SNAPSHOT encSnap;
+ST_TRAJ_POINT ref;
+#ifndef PID_FIXED_POINT
+ST_PID_GAINS gains;
+#endif /* PID_FIXED_POINT */
 /*
 
 What information is really available to us?
@@ -229,14 +782,19 @@ What information is really available to us?
 	if (!pidSettings.Enable)
 		return false; //Nope
 
-	pidSettings.Position = devMotorControl::GetPosition();
+	//One consistent sample of the encoder for this whole pass
+	devMotorControl::GetSnapshot(&encSnap);
+	pidSettings.Position = devMotorControl::GetPosition(&encSnap);
 	pidSettings.TimeToTarget = ((float)(millis() - pidSettings.startTime))/1000.0;
 	posError = pidSettings.Target - pidSettings.Position;
+	encSpeed = devMotorControl::UpdateSpeed_MT(&encSnap);
+#ifdef PID_CSV_STREAM
 	dacSpeed = devMotorControl::GetSpeed_DAC();
-	encSpeed = devMotorControl::GetSpeed_ENC();
-	avgSpeed = devMotorControl::GetSpeed_AVG();
+	avgSpeed = devMotorControl::GetSpeed_AVG(&encSnap);
+#endif /* PID_CSV_STREAM */
 
-	if (abs(posError) < MOTOR_POS_INCREMENT_DEG) //We are within 1 full Pulse width of our target
+	//We are within 1 full Pulse width of our target (and it is the last one, and we are not tracking)
+	if ((abs(posError) < MOTOR_POS_INCREMENT_DEG) && (appTrajectory::QueueCount() == 0) && (!appTrajectory::Tracking()))
 	{
 		//if ((abs(pidControl.Speed) / pidControl.Period) <= pidControl.MaxAccel)
 		if (abs(encSpeed) <= pidSettings.MinSpeed)
@@ -250,7 +808,7 @@ What information is really available to us?
 
 #ifndef PID_CSV_STREAM
 				iPrintF(trPIDCTRL,  "[PID] Position: %s\n",			stdUtils::floatToStr(pidSettings.Position, 3));
-				timerUtils::msTimerStop(&pidUpdatePosTimer);
+				timerUtils::msTimerRemove(&pidUpdatePosTimer);
 #endif /* #ifdef PID_CSV_STREAM */
 				//Print time taken to reach destination, with offset degrees moved
 				iPrintF(trALWAYS | trPIDCTRL,  "[PID]%s degs ",
@@ -284,26 +842,91 @@ What information is really available to us?
 
 			//Reset the integral (accumalating) error
 			pidSettings.intError = 0;
+#ifdef PID_FIXED_POINT
+			pidFixed.intError = 0;
+#endif /* PID_FIXED_POINT */
 
 			return pidSettings.Enable;
 		}
 	}
 
-	if(!timerUtils::msTimerPoll(&pidTimer))
+	//The inner velocity loop runs (much) more often than the control step below
+	ticks = timerUtils::usTickTake(&timerUtils::velTick);
+	if (!pidCascaded())
+		pidVelOn = false;
+	else if (ticks > 0)
+		pidVelStep(encSpeed, ticks);
+
+	//Is it time for the next control step?
+	ticks = timerUtils::usTickTake(&timerUtils::ctlTick);
+	if (ticks == 0)
 		return pidSettings.Enable;
 
-	timerUtils::msTimerReset(&pidTimer);
+	//Work with the time that has really passed since the last step, not the
+	// time it should have been.
+	now_tick = timerUtils::tickNow();
+	elapsed = now_tick - ctlStats.LastTick;
+	dt = ((float)elapsed) * (1.0 / (1000000.0 * TICKS_PER_US));
+	ctlStats.LastTick = now_tick;
+	ctlStats.dt = dt;
+	if (abs(dt - pidSettings.Period) > ctlStats.Jitter)
+		ctlStats.Jitter = abs(dt - pidSettings.Period);
+	if (ticks > 1)
+		ctlStats.Overruns += (ticks - 1);
+
+	//Done with this move? Then straight on to the next waypoint, from where
+	// (and as fast as) the plan left us.
+	tracking = appTrajectory::Next(elapsed, &ref);
+	if ((!tracking) && (pidNextWaypoint(appTrajectory::Plan.Target, appTrajectory::Plan.EndVel)))
+		tracking = appTrajectory::Next(0, &ref);
+
+	//The fastest we can go and still stop where we must...
+#ifdef PID_FIXED_POINT
+	spdTarget = brakeSpeed_q16(pidFixed.StopPos - (((long)encSnap.Position) * PID_Q16_PER_COUNT));
+#else
+	spdTarget = brakeSpeed_q16(stdUtils::q16FromFloat(pidStopPos - pidSettings.Position));
+#endif /* PID_FIXED_POINT */
+
+	//...but while there is a planned move we follow it: its velocity, plus a
+	// correction for how far we are behind (or ahead of) it.
+	if (tracking)
+	{
+		spdTrack = stdUtils::q16FromFloat(ref.Vel + (PID_TRACK_GAIN * (ref.Pos - pidSettings.Position)));
+		if ((spdTarget >= 0)? (spdTrack < spdTarget) : (spdTrack > spdTarget))
+			spdTarget = spdTrack;
+
+		//The speed the move needs anyway goes straight to the DAC (through the
+		// inverse Xfer model), leaving the PID only what is left over.
+#ifdef PID_FIXED_POINT
+		spdFf = stdUtils::q16Add(stdUtils::q16Mul(pidFixed.Kff, stdUtils::q16FromFloat(ref.Vel)),
+								 stdUtils::q16Mul(pidFixed.Kaff, stdUtils::q16FromFloat(ref.Accel)));
+#else
+		spdFf = stdUtils::q16FromFloat((pidSettings.Kff * ref.Vel) + (pidSettings.Kaff * ref.Accel));
+#endif /* PID_FIXED_POINT */
+	}
+
+#ifdef PID_FIXED_POINT
+	pidSettings.aiming = true;
+	pidSettings.Speed = pidStep_q16(spdTarget, spdFf, elapsed);
 
-	spdBound = sqrtf(2*pidSettings.MaxAccel*abs(posError)) * sign_f(posError);
-	spdError = spdBound - pidSettings.Speed;
+	return pidSettings.Enable;
+#else
+	spdBound = stdUtils::q16ToFloat(spdTarget);
+	spdFeedFwd = stdUtils::q16ToFloat(spdFf);
+	spdError = (spdBound - spdFeedFwd) - (pidSettings.Speed - pidFeedFwd);
 
-	pidSettings.intError += (spdError * pidSettings.Period);
-	pidSettings.derError = ((spdError - pidSettings.error)/pidSettings.Period);
+	pidSettings.intError += (spdError * dt);
+	pidSettings.derError = ((spdError - pidSettings.error)/dt);
 
-	spdOutput = (pidSettings.Kp * spdError) +
-				(pidSettings.Ki * pidSettings.intError) +
-				(pidSettings.Kd * pidSettings.derError) +
+	//The gains for the speed we are going at (or the way we want to go, if standing still)
+	pidScheduleGains((pidSettings.Speed != 0.0)? pidSettings.Speed : spdBound, &gains);
+
+	spdOutput = spdFeedFwd +
+				(gains.Kp * spdError) +
+				(gains.Ki * pidSettings.intError) +
+				(gains.Kd * pidSettings.derError) +
 				 pidSettings.bias;
+	pidFeedFwd = spdFeedFwd;
 
 	//PrintF("[PID],Time,Pos,PosErr,Spd,Bound,SpdErr,Kp,Ki,Kd,bias,Output,SpdOut\n");
 
@@ -326,12 +949,6 @@ What information is really available to us?
 
 	//iPrintF(trPIDCTRL,  "[PID]% 7s: ", stdUtils::floatToStr((float)(millis()-pidControl.startTime)/1000.0, 3));
 	//iPrintF(trPIDCTRL,  "% 7s\n", stdUtils::floatToStr(pidControl.Position, 3));
-#else
-	if(timerUtils::msTimerPoll(&pidUpdatePosTimer))
-	{
-		iPrintF(trPIDCTRL,  "[PID] Position: %s\n",			stdUtils::floatToStr(pidSettings.Position, 3));
-		timerUtils::msTimerReset(&pidUpdatePosTimer);
-	}
 #endif /* #ifdef PID_CSV_STREAM */
 
 	pidSettings.error = spdError;
@@ -340,9 +957,9 @@ What information is really available to us?
 	//curSpeed = MotorControl.GetSpeed_ENC();
 
 	//Limit the acceleration to our max accell value.
-	thisAccel = ((spdOutput - pidSettings.Speed) / pidSettings.Period);
+	thisAccel = ((spdOutput - pidSettings.Speed) / dt);
 	if (abs(thisAccel)  > pidSettings.MaxAccel)
-		spdOutput  = pidSettings.Speed + (sign_f(thisAccel) * pidSettings.MaxAccel * pidSettings.Period);
+		spdOutput  = pidSettings.Speed + (sign_f(thisAccel) * pidSettings.MaxAccel * dt);
 
 #ifdef PID_CSV_STREAM
 	iPrintF(trPIDCTRL,  ",%s",	stdUtils::floatToStr(spdOutput, 3));
@@ -362,10 +979,266 @@ What information is really available to us?
 	pidSettings.aiming = true;
 	pidSettings.Speed = spdOutput;
 
-	devMotorControl::SetSpeed_degs(spdOutput);
+	//With the inner loop, this is only the speed it must hold (see pidVelStep)
+	if (!pidCascaded())
+		devMotorControl::SetSpeed_degs(spdOutput);
 
 	return pidSettings.Enable;
+#endif /* PID_FIXED_POINT */
+}
+
+/*******************************************************************************
+
+The control step of PID_Process() in Q16.16 fixed point (PID_FIXED_POINT).
+It is the same sum as the float step, with the divisions by dt turned into
+multiplies, and the final speed goes to the DAC through SetSpeed_q16() (or to
+the inner velocity loop), so there is no soft float work left in here at all.
+"spdTarget" is the speed we want (deg/s, Q16.16) and "elapsed" the ticks since
+the last step. "spdFf" is the part of spdTarget that is fed forward (deg/s,
+Q16.16)... the PID only works on the rest.
+Returns the speed (deg/s) now set on the DAC.
+
+ *******************************************************************************/
+#ifdef PID_FIXED_POINT
+float pidStep_q16(long spdTarget, long spdFf, unsigned long elapsed)
+{
+long spdError;
+long spdOutput;
+long derError;
+long maxStep;
+long dt;		/* s, Q4.28 (a Q16.16 dt is far too coarse at 1ms) */
+long invDt;		/* 1/s, Q16.16 */
+long gains[3];	/* Kp, Ki and Kd, Q16.16 */
+
+	if (elapsed < PID_DT_TICKS_MIN)
+		elapsed = PID_DT_TICKS_MIN;
+	else if (elapsed > PID_DT_TICKS_MAX)
+		elapsed = PID_DT_TICKS_MAX;
+
+	dt = stdUtils::mulShift((long)elapsed, PID_Q28_PER_TICK, 16);
+	invDt = (long)((PID_TICKS_PER_S_Q8 / elapsed) << 8);
+
+	spdError = (spdTarget - spdFf) - (pidFixed.Speed - pidFixed.FeedFwd);
+
+	pidFixed.intError = stdUtils::q16Add(pidFixed.intError, stdUtils::mulShift(spdError, dt, 28));
+	derError = stdUtils::mulShift(spdError - pidFixed.error, invDt, 16);
+
+	pidScheduleGains_q16((pidFixed.Speed != 0)? pidFixed.Speed : spdTarget, gains);
+
+	spdOutput = stdUtils::q16Add(
+					stdUtils::q16Add(stdUtils::q16Mul(gains[0], spdError), stdUtils::q16Mul(gains[1], pidFixed.intError)),
+					stdUtils::q16Add(stdUtils::q16Mul(gains[2], derError), pidFixed.bias));
+	spdOutput = stdUtils::q16Add(spdOutput, spdFf);
+
+	pidFixed.error = spdError;
+	pidFixed.FeedFwd = spdFf;
+
+	//Limit the acceleration to our max accell value.
+	maxStep = stdUtils::mulShift(pidFixed.MaxAccel, dt, 28);
+	if (spdOutput > (pidFixed.Speed + maxStep))
+		spdOutput = pidFixed.Speed + maxStep;
+	else if (spdOutput < (pidFixed.Speed - maxStep))
+		spdOutput = pidFixed.Speed - maxStep;
+
+	//Limit the Speed to our max speed value.
+	if (spdOutput > pidFixed.MaxSpeed)
+		spdOutput = pidFixed.MaxSpeed;
+	else if (spdOutput < -pidFixed.MaxSpeed)
+		spdOutput = -pidFixed.MaxSpeed;
+
+	pidFixed.Speed = spdOutput;
+	if (!pidCascaded())
+		devMotorControl::SetSpeed_q16(spdOutput);
 
+#ifdef PID_CSV_STREAM
+	iPrintF(trPIDCTRL,  "[PID],%s",		stdUtils::floatToStr(appPidControl::pidSettings.TimeToTarget, 2));
+	iPrintF(trPIDCTRL,  ",%s",			stdUtils::floatToStr(appPidControl::pidSettings.Target - appPidControl::pidSettings.Position, 3));
+	iPrintF(trPIDCTRL,  ",%s",			stdUtils::floatToStr(stdUtils::q16ToFloat(spdTarget), 3));
+	iPrintF(trPIDCTRL,  ",%s",			stdUtils::floatToStr(stdUtils::q16ToFloat(spdError), 3));
+	iPrintF(trPIDCTRL,  ",%s\n",		stdUtils::floatToStr(stdUtils::q16ToFloat(spdOutput), 3));
+#endif /* PID_CSV_STREAM */
+
+	return stdUtils::q16ToFloat(spdOutput);
+}
+
+/*******************************************************************************
+
+pidScheduleGains() in Q16.16 fixed point, from the copy of the schedule made
+by UpdateSettings(). "speed" is in deg/s and "gains" gets Kp, Ki and Kd.
+
+ *******************************************************************************/
+void pidScheduleGains_q16(long speed, long * gains)
+{
+byte dir = (speed < 0)? GS_DIR_NEG : GS_DIR_POS;
+long frac;
+byte i;
+
+	if (!appPidControl::gainSchedule.Enable)
+	{
+		gains[0] = pidFixed.Kp;
+		gains[1] = pidFixed.Ki;
+		gains[2] = pidFixed.Kd;
+		return;
+	}
+
+	if (speed < 0)
+		speed = -speed;
+
+	for (i = 1; (i < GS_POINTS) && (speed > pidFixed.GsSpeed[i]); i++);
+
+	for (byte k = 0; k < 3; k++)
+	{
+		if (i >= GS_POINTS)
+			gains[k] = pidFixed.GsGains[dir][GS_POINTS - 1][k];
+		else if (speed <= pidFixed.GsSpeed[i - 1])
+			gains[k] = pidFixed.GsGains[dir][i - 1][k];
+		else
+		{
+			frac = stdUtils::mulShift(speed - pidFixed.GsSpeed[i - 1], pidFixed.GsInvStep[i - 1], 16);
+			gains[k] = pidFixed.GsGains[dir][i - 1][k] +
+					   stdUtils::q16Mul(pidFixed.GsGains[dir][i][k] - pidFixed.GsGains[dir][i - 1][k], frac);
+		}
+	}
+}
+#endif /* PID_FIXED_POINT */
+
+/*******************************************************************************
+
+Works out the Kp, Ki and Kd to use at "speed" (deg/s) from the gain schedule:
+the sign picks the direction's table, and between two breakpoints we take the
+straight line from the one's gains to the other's. Below the first breakpoint
+and above the last, their gains are used as they are. With the schedule off,
+these are simply pidSettings.Kp/Ki/Kd.
+
+ *******************************************************************************/
+#ifndef PID_FIXED_POINT
+void pidScheduleGains(float speed, ST_PID_GAINS * gains)
+{
+const ST_PID_GAINS * lo;
+const ST_PID_GAINS * hi;
+const float * bp = appPidControl::gainSchedule.Speed;
+float frac;
+byte i;
+
+	if (!appPidControl::gainSchedule.Enable)
+	{
+		gains->Kp = appPidControl::pidSettings.Kp;
+		gains->Ki = appPidControl::pidSettings.Ki;
+		gains->Kd = appPidControl::pidSettings.Kd;
+		return;
+	}
+
+	lo = appPidControl::gainSchedule.Gains[(speed < 0.0)? GS_DIR_NEG : GS_DIR_POS];
+	speed = abs(speed);
+
+	//The first breakpoint at (or above) our speed
+	for (i = 1; (i < GS_POINTS) && (speed > bp[i]); i++);
+
+	if (i >= GS_POINTS)
+	{
+		*gains = lo[GS_POINTS - 1];
+		return;
+	}
+	if (speed <= bp[i - 1])
+	{
+		*gains = lo[i - 1];
+		return;
+	}
+
+	hi = &lo[i];
+	lo = &lo[i - 1];
+	frac = (speed - bp[i - 1]) / (bp[i] - bp[i - 1]);
+	gains->Kp = lo->Kp + ((hi->Kp - lo->Kp) * frac);
+	gains->Ki = lo->Ki + ((hi->Ki - lo->Ki) * frac);
+	gains->Kd = lo->Kd + ((hi->Kd - lo->Kd) * frac);
+}
+#endif /* PID_FIXED_POINT */
+
+/*******************************************************************************
+
+Is the inner velocity loop in use? (Kvp or Kvi more than 0)
+
+ *******************************************************************************/
+bool pidCascaded(void)
+{
+	return ((appPidControl::pidSettings.Kvp > 0.0) || (appPidControl::pidSettings.Kvi > 0.0));
+}
+
+/*******************************************************************************
+
+The inner velocity loop: every PID_VEL_PERIOD_US it sets the DAC so that the
+encoder speed "encSpeed" (deg/s) holds the speed the control step wants
+(pidSettings.Speed). That speed goes through the Xfer model as it is, and a PI
+on the speed error corrects whatever the model gets wrong (the non-linear
+motor controller, wind on the dish...) far faster than the control step can.
+What it sets is kept within MaxSpeed and MaxAccel, as the control step is.
+"ticks" is the number of inner loop periods since the last time.
+
+ *******************************************************************************/
+void pidVelStep(float encSpeed, byte ticks)
+{
+#ifdef PID_FIXED_POINT
+long spdError;
+long spdOutput;
+long spdLimited;
+long maxStep = stdUtils::mulShift(pidFixed.MaxAccel, PID_VEL_DT_Q28 * ticks, 28);
+
+	//Just turned on (kvp/kvi written, or a new move): no integral from before
+	if (!pidVelOn)
+	{
+		pidFixed.VelInt = 0;
+		pidFixed.VelOut = pidFixed.Speed;
+		pidVelOn = true;
+	}
+
+	spdError = pidFixed.Speed - stdUtils::q16FromFloat(encSpeed);
+
+	spdOutput = stdUtils::q16Add(pidFixed.Speed,
+					stdUtils::q16Add(stdUtils::q16Mul(pidFixed.Kvp, spdError), stdUtils::q16Mul(pidFixed.Kvi, pidFixed.VelInt)));
+
+	//The same limits as the control step: MaxAccel (from our last output)...
+	spdLimited = constrain(spdOutput, pidFixed.VelOut - maxStep, pidFixed.VelOut + maxStep);
+	//...and MaxSpeed
+	spdLimited = constrain(spdLimited, -pidFixed.MaxSpeed, pidFixed.MaxSpeed);
+
+	//Only keep integrating while we are not at a limit already (anti wind-up)
+	if (spdLimited == spdOutput)
+		pidFixed.VelInt = stdUtils::q16Add(pidFixed.VelInt, stdUtils::mulShift(spdError, PID_VEL_DT_Q28 * ticks, 28));
+
+	pidFixed.VelOut = spdLimited;
+	devMotorControl::SetSpeed_q16(spdLimited);
+#else
+float spdError;
+float spdOutput;
+float spdLimited;
+float maxStep = appPidControl::pidSettings.MaxAccel * PID_VEL_PERIOD * ticks;
+
+	//Just turned on (kvp/kvi written, or a new move): no integral from before
+	if (!pidVelOn)
+	{
+		pidVelInt = 0.0;
+		pidVelOut = appPidControl::pidSettings.Speed;
+		pidVelOn = true;
+	}
+
+	spdError = appPidControl::pidSettings.Speed - encSpeed;
+
+	spdOutput = appPidControl::pidSettings.Speed +
+				(appPidControl::pidSettings.Kvp * spdError) +
+				(appPidControl::pidSettings.Kvi * pidVelInt);
+
+	//The same limits as the control step: MaxAccel (from our last output)...
+	spdLimited = constrain(spdOutput, pidVelOut - maxStep, pidVelOut + maxStep);
+	//...and MaxSpeed
+	spdLimited = constrain(spdLimited, -appPidControl::pidSettings.MaxSpeed, appPidControl::pidSettings.MaxSpeed);
+
+	//Only keep integrating while we are not at a limit already (anti wind-up)
+	if (spdLimited == spdOutput)
+		pidVelInt += (spdError * PID_VEL_PERIOD * ticks);
+
+	pidVelOut = spdLimited;
+	devMotorControl::SetSpeed_degs(spdLimited);
+#endif /* PID_FIXED_POINT */
 }
 
 /*******************************************************************************
@@ -399,10 +1272,17 @@ float offset;
 				//PrintF(". Current Speed: %s deg/s!\n", stdUtils::floatToStr(spd , 2));
 				//If we know where the real 0 is.. we rather want to move in that direction
 				appPidControl::pidSettings.Target = offset;//realPos * (-1.0);
+				appPidControl::UpdateSettings();
+				pidPlanMove(pidSettings.Position, pidSettings.Speed);
 				ControlState = stateCAL_GOTO_0;
 			}
 			break;
 
+		case stateAUTOTUNE:
+			//The relay does its own thing, the PID is off
+			pidTuneStep();
+			break;
+
 		case stateCAL_GOTO_0:
 			//Are we there yet?
 			if ((stdUtils::GetStatus(statusPID_DONE)) && (!stdUtils::GetStatus(statusPID_BUSY)))
@@ -448,12 +1328,206 @@ void appPidControl::StartCalibration(void)
 {
 	//PrintF("CAL - Start!\n");
 
+	AutoTuneAbort();
 	ControlState = stateCAL_SEARCH;
 	stdUtils::SetStatus(statusCALIB_BUSY);
+	appTrajectory::QueueClear();
+	pidLegSpeed = 0.0;
 	appPidControl::pidSettings.Target = 360.0;
 	appPidControl::Start();
 	//devComms::readSetting("status");
 }
+
+/*******************************************************************************
+
+Starts the autotune of the inner velocity loop: a relay experiment around
+where we are. The relay sets +autoTune.Relay on the DAC while the encoder
+speed is below the centre (0, pulled slightly back towards the start so we
+don't wander off) and -autoTune.Relay while it is above it. The motor's lag
+makes the speed swing around the centre with the ultimate period Tu, and the
+describing function of the relay gives the ultimate gain:
+	Ku = 4 x Relay / (pi x sqrt(a^2 - h^2))
+with "a" half the peak to peak speed and "h" the hysteresis.
+
+The Kp/Ki/Kd step is not closed around the encoder (it works on the speed it
+set itself), so the gains worked out are those of the loop that is... Kvp/Kvi
+(see pidVelStep). Nothing is changed until AutoTuneAccept().
+Returns false if we are moving, calibrating or tuning already.
+
+ *******************************************************************************/
+bool appPidControl::AutoTuneStart(void)
+{
+	if ((ControlState != stateIDLE) || (pidSettings.Enable))
+		return false;
+
+	appTrajectory::QueueClear();
+	autoTune.Ku = 0.0;
+	autoTune.Tu = 0.0;
+	autoTune.Kvp = 0.0;
+	autoTune.Kvi = 0.0;
+
+	tuneStartPos = devMotorControl::GetPosition();
+	tuneStartMs = millis();
+	tuneLastTick = timerUtils::tickNow();
+	tunePeriodSum = 0;
+	tuneAmpSum = 0.0;
+	tuneVelMax = 0.0;
+	tuneVelMin = 0.0;
+	tuneCycles = 0;
+	tuneRelay = 1;
+
+	stdUtils::ClearStatus(statusTUNE_DONE);
+	stdUtils::SetStatus(statusTUNE_BUSY);
+	ControlState = stateAUTOTUNE;
+
+	//The relay is checked as often as the inner loop would run
+	timerUtils::usTickStart(&timerUtils::velTick, PID_VEL_PERIOD_US);
+	devMotorControl::SetSpeed_degs(autoTune.Relay);
+
+	return true;
+}
+
+/*******************************************************************************
+
+One step of the relay experiment (see AutoTuneStart), every PID_VEL_PERIOD_US
+
+ *******************************************************************************/
+void pidTuneStep(void)
+{
+ST_ENC_SNAPSHOT encSnap;
+float pos;
+float encSpeed;
+float centre;
+unsigned long now_tick;
+
+	if (timerUtils::usTickTake(&timerUtils::velTick) == 0)
+		return;
+
+	devMotorControl::GetSnapshot(&encSnap);
+	pos = devMotorControl::GetPosition(&encSnap);
+	encSpeed = devMotorControl::UpdateSpeed_MT(&encSnap);
+	now_tick = timerUtils::tickNow();
+
+	//Running away, or not swinging at all?
+	if ((abs(pos - tuneStartPos) > TUNE_POS_RANGE) || ((millis() - tuneStartMs) > TUNE_TIMEOUT_MS))
+	{
+		pidTuneEnd(false);
+		return;
+	}
+
+	if (encSpeed > tuneVelMax)
+		tuneVelMax = encSpeed;
+	if (encSpeed < tuneVelMin)
+		tuneVelMin = encSpeed;
+
+	centre = TUNE_PULL_GAIN * (tuneStartPos - pos);
+
+	if ((tuneRelay > 0) && (encSpeed > (centre + TUNE_HYSTERESIS)))
+	{
+		tuneRelay = -1;
+		devMotorControl::SetSpeed_degs(-appPidControl::autoTune.Relay);
+	}
+	else if ((tuneRelay < 0) && (encSpeed < (centre - TUNE_HYSTERESIS)))
+	{
+		tuneRelay = 1;
+		devMotorControl::SetSpeed_degs(appPidControl::autoTune.Relay);
+
+		//A full cycle since the last upward switch
+		if (tuneCycles >= TUNE_CYCLES_SKIP)
+		{
+			tunePeriodSum += (now_tick - tuneLastTick);
+			tuneAmpSum += ((tuneVelMax - tuneVelMin) / 2.0);
+		}
+		tuneLastTick = now_tick;
+		tuneVelMax = encSpeed;
+		tuneVelMin = encSpeed;
+
+		if (++tuneCycles >= (TUNE_CYCLES_SKIP + TUNE_CYCLES))
+			pidTuneEnd(true);
+	}
+}
+
+/*******************************************************************************
+
+Ends the relay experiment and, if "measured", works out Ku, Tu and the gains
+of the selected rule (see tuneRules).
+
+ *******************************************************************************/
+void pidTuneEnd(bool measured)
+{
+float amp;
+float kc;
+
+	devMotorControl::Stop();
+	timerUtils::usTickStop(&timerUtils::velTick);
+	appPidControl::ControlState = stateIDLE;
+	stdUtils::ClearStatus(statusTUNE_BUSY);
+
+	amp = tuneAmpSum / TUNE_CYCLES;
+	if ((!measured) || (amp <= TUNE_HYSTERESIS))
+	{
+		iPrintF(trALWAYS | trPIDCTRL,  "[PID]Autotune failed after %d cycles\n", tuneCycles);
+		return;
+	}
+
+	appPidControl::autoTune.Tu = ((float)tunePeriodSum) * (1.0 / (1000000.0 * TICKS_PER_US * TUNE_CYCLES));
+	appPidControl::autoTune.Ku = (4.0 * appPidControl::autoTune.Relay) / (M_PI * sqrt((amp * amp) - (TUNE_HYSTERESIS * TUNE_HYSTERESIS)));
+
+	//The same limits as the "kvp" and "kvi" settings
+	kc = pgm_read_float(&tuneRules[appPidControl::autoTune.Rule][0]) * appPidControl::autoTune.Ku;
+	appPidControl::autoTune.Kvp = (kc < 10.0)? kc : 10.0;
+	kc = appPidControl::autoTune.Kvp / (pgm_read_float(&tuneRules[appPidControl::autoTune.Rule][1]) * appPidControl::autoTune.Tu);
+	appPidControl::autoTune.Kvi = (kc < 100.0)? kc : 100.0;
+
+	stdUtils::SetStatus(statusTUNE_DONE);
+
+	iPrintF(trALWAYS | trPIDCTRL,  "[PID]Autotune Ku: %s, ", stdUtils::floatToStr(appPidControl::autoTune.Ku, 3));
+	iPrintF(trALWAYS | trPIDCTRL,  "Tu: %s s\n", stdUtils::floatToStr(appPidControl::autoTune.Tu, 3));
+}
+
+/*******************************************************************************
+
+Writes the gains of the last successful autotune into pidSettings.
+Returns false if there are none (yet).
+
+ *******************************************************************************/
+bool appPidControl::AutoTuneAccept(void)
+{
+	if (!stdUtils::GetStatus(statusTUNE_DONE))
+		return false;
+
+	pidSettings.Kvp = autoTune.Kvp;
+	pidSettings.Kvi = autoTune.Kvi;
+	UpdateSettings();
+	stdUtils::ClearStatus(statusTUNE_DONE);
+
+	return true;
+}
+
+/*******************************************************************************
+
+Stops the autotune (if busy), without any results
+
+ *******************************************************************************/
+void appPidControl::AutoTuneAbort(void)
+{
+	if (ControlState == stateAUTOTUNE)
+		pidTuneEnd(false);
+}
+
+/*******************************************************************************
+
+Sets the rule of the next autotune (TUNE_RULE_xxx)
+Returns the new setting
+
+ *******************************************************************************/
+byte appPidControl::SetTuneRule(byte rule)
+{
+	if (rule <= TUNE_RULE_MAX)
+		autoTune.Rule = rule;
+
+	return autoTune.Rule;
+}
 /*******************************************************************************
 
 Provides access to the PID controller variables/constantsthrough the console
@@ -495,16 +1569,35 @@ int retVal;
 			stdUtils::ClearStatus(statusPID_BUSY);
 			stdUtils::ClearStatus(statusPID_DONE);
 			pidSettings.Enable = false;
+			appTrajectory::Stop();
+			appTrajectory::QueueClear();
+			pidLegSpeed = 0.0;
 			devMotorControl::Stop();
 		}
 		paramStr = "ALL";
 	}
 
+	if (strcasecmp(paramStr, "Tune") == NULL)
+	{
+		if ((valueStr) && (strcasecmp(valueStr, "Accept") == NULL))
+			retVal = AutoTuneAccept();
+		else if ((valueStr) && (strcasecmp(valueStr, "Abort") == NULL))
+		{
+			AutoTuneAbort();
+			retVal = true;
+		}
+		else
+			retVal = AutoTuneStart();
+		PrintF(" * Tune   : %s\n", (retVal)? "OK" : "Busy/None");
+		return;
+	}
+
 	if (strcasecmp(paramStr, "Default") == NULL)
 	{
 		if (!valueStr)
 		{
-			memcpy(&pidSettings, &pidControlDefault, sizeof(ST_PID));
+			memcpy_P(&pidSettings, &pidControlDefault, sizeof(ST_PID));
+			BrakeTableBuild();
 			paramStr = "ALL";
 		}
 	}
@@ -516,7 +1609,8 @@ int retVal;
 		else if (retVal >= 0)
 		{
 			PrintF(" * Target : % 7s deg\n", stdUtils::floatToStr(pidSettings.Target, 2));
-			Start();
+			pidLegSpeed = 0.0;
+			Retarget();
 			return;
 		}
 	}
@@ -533,13 +1627,43 @@ int retVal;
 	if (retVal == -2) 		return;
 	else if (retVal >= 0)	paramIndex = 3;
 
-	retVal = stdUtils::setFloatParam("Period", paramStr, valueStr, &pidSettings.Period, 0.01, 1.0);
+	//The control tick only picks up a new period in Start() (see SetPeriod)
+	if ((strcasecmp(paramStr, "Period") == NULL) && (valueStr) && (pidSettings.Enable))
+	{
+		PrintF("Cannot change the Period while moving\n\n");
+		return;
+	}
+	retVal = stdUtils::setFloatParam("Period", paramStr, valueStr, &pidSettings.Period, PID_PERIOD_MIN, 1.0);
 	if (retVal == -2) 		return;
 	else if (retVal >= 0)	paramIndex = 4;
 
 	retVal = stdUtils::setFloatParam("MaxAcc", paramStr, valueStr, &pidSettings.MaxAccel, 0.0, 72.0);
 	if (retVal == -2) 		return;
-	else if (retVal >= 0)	paramIndex = 8;
+	else if (retVal >= 0)
+	{
+		paramIndex = 8;
+		BrakeTableBuild();
+	}
+
+	retVal = stdUtils::setFloatParam("MaxJrk", paramStr, valueStr, &pidSettings.MaxJerk, 0.0, 1000.0);
+	if (retVal == -2) 		return;
+	else if (retVal >= 0)	paramIndex = 12;
+
+	retVal = stdUtils::setFloatParam("Kff", paramStr, valueStr, &pidSettings.Kff, 0.0, 2.0);
+	if (retVal == -2) 		return;
+	else if (retVal >= 0)	paramIndex = 13;
+
+	retVal = stdUtils::setFloatParam("Kaff", paramStr, valueStr, &pidSettings.Kaff, 0.0, 5.0);
+	if (retVal == -2) 		return;
+	else if (retVal >= 0)	paramIndex = 14;
+
+	retVal = stdUtils::setFloatParam("Kvp", paramStr, valueStr, &pidSettings.Kvp, 0.0, 10.0);
+	if (retVal == -2) 		return;
+	else if (retVal >= 0)	paramIndex = 15;
+
+	retVal = stdUtils::setFloatParam("Kvi", paramStr, valueStr, &pidSettings.Kvi, 0.0, 100.0);
+	if (retVal == -2) 		return;
+	else if (retVal >= 0)	paramIndex = 16;
 
 	retVal = stdUtils::setFloatParam("MaxSpd", paramStr, valueStr, &pidSettings.MaxSpeed, 0.0, MOTOR_SPD_ABS_MAX);
 	if (retVal == -2) 		return;
@@ -554,19 +1678,37 @@ int retVal;
 	else if (retVal >= 0)	paramIndex = 5;
 
 
+	//Whatever was changed, the control step must see it
+	UpdateSettings();
+
 	if (strcasecmp(paramStr, "ALL") == NULL)
 	{
 		PrintF("The PID paramater values are:\n");
 		PrintF(" Kp    : % 7s\n", stdUtils::floatToStr(pidSettings.Kp, 3));
 		PrintF(" Ki    : % 7s\n", stdUtils::floatToStr(pidSettings.Ki, 3));
 		PrintF(" Kd    : % 7s\n", stdUtils::floatToStr(pidSettings.Kd, 3));
+		PrintF(" GainSc: % 7s\n", (gainSchedule.Enable)? "ON" : "OFF");
+		PrintF(" Kff   : % 7s\n", stdUtils::floatToStr(pidSettings.Kff, 3));
+		PrintF(" Kaff  : % 7s s\n", stdUtils::floatToStr(pidSettings.Kaff, 3));
+		PrintF(" Kvp   : % 7s\n", stdUtils::floatToStr(pidSettings.Kvp, 3));
+		PrintF(" Kvi   : % 7s\n", stdUtils::floatToStr(pidSettings.Kvi, 3));
 		PrintF(" dt    : % 7s s\n", stdUtils::floatToStr(pidSettings.Period, 3));
+		PrintF(" Act dt: % 7s s", stdUtils::floatToStr(ctlStats.dt, 4));
+		PrintF(" (jitter %s s, ", stdUtils::floatToStr(ctlStats.Jitter, 4));
+		PrintF("%u overruns)\n", ctlStats.Overruns);
 		PrintF(" Bias  : % 7s\n", stdUtils::floatToStr(pidSettings.bias, 3));
 		PrintF(" Target: % 7s degs\n", stdUtils::floatToStr(pidSettings.Target, 3));
 		PrintF(" Pos   : % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetPosition(), 3));
 		PrintF(" MinSpd: % 7s deg/s\n", stdUtils::floatToStr(pidSettings.MinSpeed, 3));
 		PrintF(" MaxSpd: % 7s deg/s\n", stdUtils::floatToStr(pidSettings.MaxSpeed, 3));
 		PrintF(" MaxAcc: % 7s deg/s/s\n", stdUtils::floatToStr(pidSettings.MaxAccel, 3));
+		PrintF(" MaxJrk: % 7s deg/s/s/s\n", stdUtils::floatToStr(pidSettings.MaxJerk, 3));
+		PrintF(" Plan  : % 7s s", stdUtils::floatToStr(appTrajectory::Duration(), 2));
+		PrintF(" (%s)\n", (appTrajectory::Active())? "busy" : "done");
+		PrintF(" Tune  : Ku %s, ", stdUtils::floatToStr(autoTune.Ku, 3));
+		PrintF("Tu %s s ", stdUtils::floatToStr(autoTune.Tu, 3));
+		PrintF("(Kvp %s, ", stdUtils::floatToStr(autoTune.Kvp, 3));
+		PrintF("Kvi %s)\n", stdUtils::floatToStr(autoTune.Kvi, 3));
 		PrintF(" State : % 7s\n", (pidSettings.Enable)? "ON" : "OFF");
 	}
 	else if ((paramIndex > 0) && (paramIndex <= 10))
@@ -581,19 +1723,46 @@ int retVal;
 	{
 		PrintF(" * Enable : % 7s\n", (pidSettings.Enable)? "ON" : "OFF");
 	}
+	else if (paramIndex == 12)
+	{
+		//Not one of the first 10 floats in ST_PID
+		PrintF(" * MaxJrk : % 7s deg/s/s/s\n", stdUtils::floatToStr(pidSettings.MaxJerk, 3));
+	}
+	else if (paramIndex == 13)
+	{
+		PrintF(" * Kff    : % 7s\n", stdUtils::floatToStr(pidSettings.Kff, 3));
+	}
+	else if (paramIndex == 14)
+	{
+		PrintF(" * Kaff   : % 7s s\n", stdUtils::floatToStr(pidSettings.Kaff, 3));
+	}
+	else if (paramIndex == 15)
+	{
+		PrintF(" * Kvp    : % 7s\n", stdUtils::floatToStr(pidSettings.Kvp, 3));
+	}
+	else if (paramIndex == 16)
+	{
+		PrintF(" * Kvi    : % 7s\n", stdUtils::floatToStr(pidSettings.Kvi, 3));
+	}
 	else
 	{
 		PrintF("Valid commands:\n");
 		PrintF("    Kp     - Proptional Constant\n");
 		PrintF("    Ki     - Integral Constant\n");
 		PrintF("    Kd     - Derivative Constant\n");
+		PrintF("    Kff    - Velocity feedforward (0 = none)\n");
+		PrintF("    Kaff   - Acceleration feedforward (s)\n");
+		PrintF("    Kvp    - Inner velocity loop Proportional (0 = no loop)\n");
+		PrintF("    Kvi    - Inner velocity loop Integral\n");
 		PrintF("    dt     - Execution Period\n");
 		PrintF("    Bias   - Small biasing constant (<1.0)\n");
 		PrintF("    Target - The target position\n");
 		PrintF("    MinSpd - Min absolute speed deg/s\n");
 		PrintF("    MaxSpd - Max absolute speed deg/s\n");
 		PrintF("    MaxAcc - Max absolute acceleration\n");
+		PrintF("    MaxJrk - Max absolute jerk (0 = none)\n");
 		PrintF("    ON/OFF - Enable/Disable\n");
+		PrintF("    Tune   - Autotune Kvp/Kvi (Accept/Abort)\n");
 		PrintF("    Default- Set Default Values\n");
 	}
 
@@ -23,6 +23,33 @@ definitions
 #define EXT extern
 #endif /* __NOT_EXTERN__ */
 
+#ifdef PID_FIXED_POINT
+	#define PID_PERIOD_MIN			0.001	/* s, shortest control period we allow */
+	#define PID_PERIOD_MIN_STR		"0.001"
+#else
+	#define PID_PERIOD_MIN			0.01
+	#define PID_PERIOD_MIN_STR		"0.01"
+#endif /* PID_FIXED_POINT */
+
+/* How GotoPos() picks between the turns of the same azimuth (-180 to 180 deg)
+ * that fit within MOTOR_POS_WRAP_MIN/MAX. Targets outside -180 to 180 are
+ * always taken as they are (the host wants that exact turn). */
+#define WRAP_LITERAL			0	/* Drive to the angle as given */
+#define WRAP_SHORTEST			1	/* The turn closest to where we are (least travel) */
+#define WRAP_CENTRE				2	/* The turn closest to 0 (least cable wrap) */
+
+/* The rule AutoTuneStart() turns the ultimate gain and period into the inner
+ * velocity loop gains with (see tuneRules) */
+#define TUNE_RULE_ZN			0	/* Ziegler-Nichols PI... fast, but little margin */
+#define TUNE_RULE_TL			1	/* Tyreus-Luyben PI... slower, with far less overshoot */
+#define TUNE_RULE_MAX			TUNE_RULE_TL
+
+/* The gain schedule: Kp/Ki/Kd for each direction at GS_POINTS speeds, with
+ * straight lines in between (see pidScheduleGains) */
+#define GS_POINTS				4
+#define GS_DIR_POS				0
+#define GS_DIR_NEG				1
+
 /******************************************************************************
 Macros
 ******************************************************************************/
@@ -65,8 +92,75 @@ typedef struct
 	bool aiming;
 
 	float TimeToTarget;
+
+	float MaxJerk;		/* The maximum jerk (degrees/s/s/s) of a planned move, 0 = no limit (trapezoid) */
+
+	float Kff;			/* Feedforward of the planned velocity (deg/s per deg/s), 0 = none */
+	float Kaff;			/* Feedforward of the planned acceleration (deg/s per deg/s/s), 0 = none */
+
+	float Kvp;			/* Proportional constant of the inner velocity loop... */
+	float Kvi;			/* ...and its integral constant. Both 0 = no inner loop (the PID sets the DAC) */
 }ST_PID;
 
+typedef struct
+{
+	long Kp;			/* Q16.16 copies of the ST_PID settings (see UpdateSettings) */
+	long Ki;
+	long Kd;
+	long bias;
+	long StopPos;		/* deg, where we must come to rest (see pidPlanMove) */
+	long MaxAccel;		/* deg/s/s */
+	long MaxSpeed;		/* deg/s */
+	long Kff;
+	long Kaff;
+
+	long Speed;			/* The Speed set on the DAC by the PID (deg/s) */
+	long error;			/* The speed error of the previous step (deg/s) */
+	long intError;		/* The integral of the speed error (deg) */
+	long FeedFwd;		/* The feedforward part of Speed (deg/s) */
+
+	long Kvp;			/* The inner velocity loop (see pidVelStep) */
+	long Kvi;
+	long VelInt;		/* The integral of its speed error (deg) */
+	long VelOut;		/* Its last output (deg/s) */
+
+	long GsSpeed[GS_POINTS];			/* The gain schedule (deg/s)... */
+	long GsInvStep[GS_POINTS - 1];		/* ...1 / (deg/s) from each speed to the next (0 if not higher)... */
+	long GsGains[2][GS_POINTS][3];		/* ...and its Kp, Ki and Kd */
+}ST_PID_Q16;	/* The state of the fixed point control step (PID_FIXED_POINT) */
+
+typedef struct
+{
+	float dt;				/* The measured time (s) between the last two control steps */
+	float Jitter;			/* The biggest difference (s) between dt and Period since Start() */
+	unsigned int Overruns;	/* Control ticks missed since Start() */
+	unsigned long LastTick;	/* timerUtils::tickNow() of the last control step */
+}ST_CTL_STATS;
+
+typedef struct
+{
+	float Relay;			/* The speed (deg/s) the relay switches between (+ and -) */
+	byte Rule;				/* TUNE_RULE_xxx */
+	float Ku;				/* The ultimate gain (deg/s per deg/s) measured, 0 = none */
+	float Tu;				/* The ultimate period (s) measured */
+	float Kvp;				/* The gains the rule gives for the inner velocity loop... */
+	float Kvi;				/* ...written to pidSettings by AutoTuneAccept() */
+}ST_AUTOTUNE;
+
+typedef struct
+{
+	float Kp;
+	float Ki;
+	float Kd;
+}ST_PID_GAINS;
+
+typedef struct
+{
+	byte Enable;						/* 0 = pidSettings.Kp/Ki/Kd everywhere */
+	float Speed[GS_POINTS];				/* The breakpoints (deg/s, absolute), from low to high */
+	ST_PID_GAINS Gains[2][GS_POINTS];	/* [GS_DIR_xxx][breakpoint] */
+}ST_GAIN_SCHEDULE;
+
 /******************************************************************************
 variables
 ******************************************************************************/
@@ -78,15 +172,34 @@ namespace appPidControl
 {
 	EXT ST_PID pidSettings;
 	EXT byte ControlState;
+	EXT ST_CTL_STATS ctlStats;
+	EXT ST_AUTOTUNE autoTune;
+	EXT ST_GAIN_SCHEDULE gainSchedule;
 
 	bool Init(void);
 	bool Enabled(void);
-	bool GotoPos(float newPos);
+	bool GotoPos(float newPos, bool resolve);
+	float ResolveTarget(float azimuth);
+	byte SetWrapPolicy(byte policy);
+	byte GetWrapPolicy(void);
+	float GetTravel(void);
+	bool QueueStart(void);
+	bool TrackStart(void);
+	bool TrackAdd(float t, float pos);
+	void TrackStop(void);
 	void Start(void);
+	void Retarget(void);
 	void Stop(void);
+	void UpdateSettings(void);
+	float SetPeriod(float period);
+	void BrakeTableBuild(void);
 	bool PID_Process(void);
 	bool ControlStateHandler(void);
 	void StartCalibration(void);
+	bool AutoTuneStart(void);
+	bool AutoTuneAccept(void);
+	void AutoTuneAbort(void);
+	byte SetTuneRule(byte rule);
 	void menuCmd(void);
 }
 #endif /* __APPPIDCONTROL_H__ */
@@ -0,0 +1,719 @@
+/******************************************************************************
+Project:    Outdoor Rotator
+Module:     appTrajectory.c
+Purpose:    This file contains the trajectory (motion profile) planner
+Author:     Rudolph van Niekerk
+Processor:  Arduino Uno Rev3 (ATmega328)
+Compiler:	Arduino AVR Compiler
+
+
+A move is planned once, when it is started, as a short list of segments of
+constant jerk (which may be 0, i.e. constant acceleration):
+
+ ^ Speed
+ |				   __________________________
+ |				 /!							 !\
+ |				/ !							 ! \
+ |			   /  !							 !  \
+ |			  /	  !							 !	 \
+ |			 /	  !							 !	  \
+ |______/_________!__________________________!_________\_________ Time
+		!         !                          !         !
+		!  accel  !          cruise          !  decel  !
+
+Without a jerk limit (MaxJerk = 0) every change of speed is one segment of
+constant acceleration, which steps instantly (trapezoidal profile). With a jerk
+limit every change of speed is 3 segments: the acceleration ramps up, stays at
+MaxAccel (if there is time to get there) and ramps down again... the seven
+segment S-curve. The speed is then a smooth S rather than the straight lines
+above.
+
+When the move starts while we are still moving away from the target (or too
+fast to stop before it), a change of speed to 0 is added in front of these. A
+move that is too short to reach MaxSpeed has no cruise segment, and the top
+speed it does reach is searched for (bisection) when it is planned.
+
+A move does not have to end at rest: with an "endSpeed" the last change of
+speed ends at that speed instead of 0, so the next move (from the waypoint
+queue) carries on from there without stopping... blending the waypoints.
+The caller picks an endSpeed the next move can still stop from (StopSpeed).
+
+While tracking (TrackStart) there is no plan at all: Next() interpolates the
+position and velocity between time-tagged (t, angle) samples instead, either
+with straight lines or a cubic Hermite curve (the slope at every sample is the
+average of the slopes on either side of it). Before the first sample and after
+the last one, the reference holds still.
+
+Every control step then only has to evaluate the current segment at the time
+passed, which gives the position and velocity we should be at (the reference)
+in O(1). The time is counted in (Timer1) ticks, so it does not drift the way a
+float sum of dt's would over a long move.
+
+ ******************************************************************************/
+
+/*******************************************************************************
+includes
+ *******************************************************************************/
+#define __NOT_EXTERN__
+#include "appTrajectory.h"
+#undef __NOT_EXTERN__
+
+#include "stdUtils.h"
+#include "timerUtils.h"
+
+/*******************************************************************************
+local defines
+ *******************************************************************************/
+#define TRAJ_TICKS_PER_S	(1000000.0 * TICKS_PER_US)
+#define TRAJ_PEAK_STEPS		16		/* Bisection steps when searching for the top speed */
+#define TRAJ_TICKS_PER_MS	(1000ul * TICKS_PER_US)
+
+/*******************************************************************************
+local variables
+ *******************************************************************************/
+float trajEndPos;		/* Where the segments planned so far leave us (deg)... */
+float trajEndVel;		/* ...and how fast we will be going then (deg/s) */
+float trajMaxAccel;		/* The limits of the move being planned */
+float trajMaxJerk;		/* ...0 = no jerk limit */
+
+//************ Waypoint queue (the main loop only) ************
+ST_TRAJ_WAYPOINT trajQueue[TRAJ_QUEUE_SIZE];
+byte trajQueueHead;		/* Where the next waypoint is added */
+byte trajQueueTail;		/* The next waypoint to move to */
+
+//************ Tracking samples (the main loop only) ************
+ST_TRAJ_SAMPLE trajTrack[TRAJ_TRACK_SIZE];
+byte trajTrackHead;			/* Where the next sample is added */
+byte trajTrackTail;			/* The oldest sample we still need */
+bool trajTracking = false;
+byte trajTrackInterp = TRAJ_INTERP_HERMITE;
+unsigned long trajTrackMs;		/* Time since TrackStart() (ms)... */
+unsigned long trajTrackTicks;	/* ...and the ticks on top of that */
+float trajTrackHold;		/* Where we stay before the first sample arrives (deg) */
+
+/*******************************************************************************
+local functions
+ *******************************************************************************/
+void trajAdvance(float * pos, float * vel, float accel, float jerk, float t);
+void trajAddSegment(float duration, float accel, float jerk);
+float trajChangeTime(float dv);
+void trajAddChange(float from, float to, float dir);
+float trajMoveDist(float from, float peak, float to);
+bool trajTrackNext(unsigned long ticks, ST_TRAJ_POINT * point);
+ST_TRAJ_SAMPLE * trajTrackSample(byte index);
+
+/*******************************************************************************
+
+Moves "pos" and "vel" on by "t" (s) of a segment starting at "accel", with a
+constant "jerk".
+
+ *******************************************************************************/
+void trajAdvance(float * pos, float * vel, float accel, float jerk, float t)
+{
+	*pos += (*vel + (((0.5 * accel) + ((jerk / 6.0) * t)) * t)) * t;
+	*vel += (accel + (0.5 * jerk * t)) * t;
+}
+
+/*******************************************************************************
+
+Adds a segment of "duration" (s), starting at "accel" (deg/s/s) with a constant
+"jerk" (deg/s/s/s), to the end of the plan.
+
+ *******************************************************************************/
+void trajAddSegment(float duration, float accel, float jerk)
+{
+ST_TRAJ_SEGMENT * seg;
+unsigned long ticks;
+
+	if ((duration <= 0.0) || (appTrajectory::Plan.SegCnt >= TRAJ_SEGMENTS_MAX))
+		return;
+
+	//Carry on from where the segment really ends, after rounding to ticks
+	ticks = (unsigned long)((duration * TRAJ_TICKS_PER_S) + 0.5);
+	if (ticks == 0)
+		return;
+	duration = ((float)ticks) / TRAJ_TICKS_PER_S;
+
+	seg = &appTrajectory::Plan.Seg[appTrajectory::Plan.SegCnt++];
+	seg->Ticks = ticks;
+	seg->Accel = accel;
+	seg->Jerk = jerk;
+
+	trajAdvance(&trajEndPos, &trajEndVel, accel, jerk, duration);
+	appTrajectory::Plan.Duration += duration;
+}
+
+/*******************************************************************************
+
+Returns the time (s) it takes to change speed by "dv" (deg/s, positive) within
+the limits of the move being planned.
+
+ *******************************************************************************/
+float trajChangeTime(float dv)
+{
+	if (trajMaxJerk <= 0.0)
+		return dv / trajMaxAccel;
+
+	//Enough time to reach MaxAccel?
+	if ((dv * trajMaxJerk) >= (trajMaxAccel * trajMaxAccel))
+		return (dv / trajMaxAccel) + (trajMaxAccel / trajMaxJerk);
+
+	return 2.0 * sqrtf(dv / trajMaxJerk);
+}
+
+/*******************************************************************************
+
+Adds the segments to change speed from "from" to "to" (deg/s, both taken in
+the direction "dir").
+As the acceleration is symmetrical, we cover (from + to)/2 x trajChangeTime().
+
+ *******************************************************************************/
+void trajAddChange(float from, float to, float dir)
+{
+float dv = abs(to - from);
+float accel;
+float rampTime;
+
+	if (dv <= 0.0)
+		return;
+
+	dir *= sign_f(to - from);
+
+	if (trajMaxJerk <= 0.0)
+	{
+		trajAddSegment(dv / trajMaxAccel, dir * trajMaxAccel, 0.0);
+		return;
+	}
+
+	if ((dv * trajMaxJerk) >= (trajMaxAccel * trajMaxAccel))
+		accel = trajMaxAccel;
+	else
+		accel = sqrtf(dv * trajMaxJerk);
+	rampTime = accel / trajMaxJerk;
+
+	trajAddSegment(rampTime, 0.0, dir * trajMaxJerk);
+	trajAddSegment((dv / accel) - rampTime, dir * accel, 0.0);
+	trajAddSegment(rampTime, dir * accel, -dir * trajMaxJerk);
+}
+
+/*******************************************************************************
+
+Returns the distance (deg) it takes to go from "from" to "peak" (deg/s) and
+then on to "to", without any cruising in between.
+
+ *******************************************************************************/
+float trajMoveDist(float from, float peak, float to)
+{
+	return (0.5 * (from + peak) * trajChangeTime(abs(peak - from))) +
+		   (0.5 * (peak + to) * trajChangeTime(abs(peak - to)));
+}
+
+/*******************************************************************************
+
+Plans a move from "startPos" (deg), while going at "startVel" (deg/s), to
+"target", never going faster than "maxSpeed" or accelerating harder than
+"maxAccel". A "maxJerk" (deg/s/s/s) of more than 0 gives an S-curve, 0 a
+trapezoid. We pass the target at "endSpeed" (deg/s, towards the target), or
+as close to it as the distance allows... 0 stops at the target.
+Returns false if there is nothing to do (we are there already, or the limits
+are invalid).
+
+ *******************************************************************************/
+bool appTrajectory::PlanMove(float startPos, float startVel, float target, float maxSpeed, float maxAccel, float maxJerk, float endSpeed)
+{
+float dir;		/* The direction of the target... the rest is worked out as if it is ahead (+) of us */
+float dist;		/* deg to go */
+float vel;		/* deg/s towards the target */
+float peak;		/* The top speed we will reach */
+float low, high;
+float cruiseDist;
+
+	Plan.SegCnt = 0;
+	Plan.SegIdx = 0;
+	Plan.SegTicks = 0;
+	Plan.SegPos = startPos;
+	Plan.SegVel = startVel;
+	Plan.Duration = 0.0;
+	Plan.Target = target;
+	Plan.EndVel = 0.0;
+	Plan.Active = false;
+	trajTracking = false;
+
+	if ((maxSpeed <= 0.0) || (maxAccel <= 0.0))
+		return false;
+
+	trajEndPos = startPos;
+	trajEndVel = startVel;
+	trajMaxAccel = maxAccel;
+	trajMaxJerk = (maxJerk > 0.0)? maxJerk : 0.0;
+
+	if (endSpeed > maxSpeed)
+		endSpeed = maxSpeed;
+	else if (endSpeed < 0.0)
+		endSpeed = 0.0;
+
+	dir = sign_f(target - startPos);
+	dist = abs(target - startPos);
+	vel = startVel * dir;
+
+	//Moving away from the target, or too fast to get down to endSpeed (and
+	// maxSpeed on the way) before we get there? Stop first.
+	if ((vel < 0.0) ||
+		((vel > endSpeed) && (trajMoveDist(vel, (vel > maxSpeed)? maxSpeed : vel, endSpeed) > dist)))
+	{
+		trajAddChange(abs(startVel), 0.0, sign_f(startVel));
+
+		//Coming back to the target, we can't carry on in the direction we were going
+		if (sign_f(target - trajEndPos) != dir)
+			endSpeed = 0.0;
+
+		dir = sign_f(target - trajEndPos);
+		dist = abs(target - trajEndPos);
+		vel = 0.0;
+	}
+
+	//Too close to even get up to endSpeed? Then we pass the target slower.
+	if ((endSpeed > vel) && (trajMoveDist(vel, endSpeed, endSpeed) > dist))
+	{
+		low = vel;
+		high = endSpeed;
+		for (byte i = 0; i < TRAJ_PEAK_STEPS; i++)
+		{
+			endSpeed = 0.5 * (low + high);
+			if (trajMoveDist(vel, endSpeed, endSpeed) > dist)
+				high = endSpeed;
+			else
+				low = endSpeed;
+		}
+		endSpeed = low;
+	}
+
+	//From here we can always get to endSpeed in time... how fast can we go on the way?
+	low = (vel > maxSpeed)? maxSpeed : ((vel > endSpeed)? vel : endSpeed);
+	if ((low >= maxSpeed) || (trajMoveDist(vel, maxSpeed, endSpeed) <= dist))
+		peak = maxSpeed;
+	else
+	{
+		high = maxSpeed;
+		for (byte i = 0; i < TRAJ_PEAK_STEPS; i++)
+		{
+			peak = 0.5 * (low + high);
+			if (trajMoveDist(vel, peak, endSpeed) > dist)
+				high = peak;
+			else
+				low = peak;
+		}
+		peak = low;
+	}
+
+	cruiseDist = dist - trajMoveDist(vel, peak, endSpeed);
+
+	trajAddChange(vel, peak, dir);
+	if ((peak > 0.0) && (cruiseDist > 0.0))
+		trajAddSegment(cruiseDist / peak, 0.0, 0.0);
+	trajAddChange(peak, endSpeed, dir);
+
+	Plan.EndVel = dir * endSpeed;
+	Plan.Active = (Plan.SegCnt > 0);
+
+	return Plan.Active;
+}
+
+/*******************************************************************************
+
+Returns the fastest speed (deg/s) from which we can still stop within "dist"
+(deg), with "maxAccel" and "maxJerk" (0 = no jerk limit).
+This is the fastest we may pass a waypoint when the next one could be the last.
+
+ *******************************************************************************/
+float appTrajectory::StopSpeed(float dist, float maxAccel, float maxJerk)
+{
+float rampSpeed;
+
+	if ((dist <= 0.0) || (maxAccel <= 0.0))
+		return 0.0;
+
+	//dist = v x v / (2 x maxAccel)
+	if (maxJerk <= 0.0)
+		return sqrtf(2.0 * maxAccel * dist);
+
+	//Above this speed the stop reaches maxAccel... and takes longer than
+	// maxAccel / maxJerk x 2 (see trajChangeTime)
+	rampSpeed = (maxAccel * maxAccel) / maxJerk;
+
+	//dist = v x sqrt(v / maxJerk)
+	if (dist <= (rampSpeed * maxAccel / maxJerk))
+		return cbrt(dist * dist * maxJerk);
+
+	//dist = v x (v / maxAccel + maxAccel / maxJerk) / 2
+	return 0.5 * (sqrtf((rampSpeed * rampSpeed) + (8.0 * maxAccel * dist)) - rampSpeed);
+}
+
+/*******************************************************************************
+
+Moves the plan on by "ticks" (see timerUtils::tickNow) and returns the
+reference in "point".
+Returns false once the plan is done... "point" is then the target, at rest.
+
+ *******************************************************************************/
+bool appTrajectory::Next(unsigned long ticks, ST_TRAJ_POINT * point)
+{
+ST_TRAJ_SEGMENT * seg;
+float t;
+
+	if (trajTracking)
+		return trajTrackNext(ticks, point);
+
+	if (Plan.Active)
+	{
+		Plan.SegTicks += ticks;
+
+		while (Plan.SegTicks >= Plan.Seg[Plan.SegIdx].Ticks)
+		{
+			//On to the next segment, from where this one ends
+			seg = &Plan.Seg[Plan.SegIdx];
+			trajAdvance(&Plan.SegPos, &Plan.SegVel, seg->Accel, seg->Jerk, ((float)seg->Ticks) / TRAJ_TICKS_PER_S);
+
+			Plan.SegTicks -= seg->Ticks;
+			if (++Plan.SegIdx >= Plan.SegCnt)
+			{
+				Plan.Active = false;
+				break;
+			}
+		}
+	}
+
+	if (!Plan.Active)
+	{
+		point->Pos = Plan.Target;
+		point->Vel = 0.0;
+		point->Accel = 0.0;
+		return false;
+	}
+
+	seg = &Plan.Seg[Plan.SegIdx];
+	t = ((float)Plan.SegTicks) * (1.0 / TRAJ_TICKS_PER_S);
+	point->Pos = Plan.SegPos;
+	point->Vel = Plan.SegVel;
+	point->Accel = seg->Accel + (seg->Jerk * t);
+	trajAdvance(&point->Pos, &point->Vel, seg->Accel, seg->Jerk, t);
+
+	return true;
+}
+
+/*******************************************************************************
+
+Are we still busy with the plan?
+
+ *******************************************************************************/
+bool appTrajectory::Active(void)
+{
+	return Plan.Active;
+}
+
+/*******************************************************************************
+
+The time (s) the planned move should take from start to finish
+
+ *******************************************************************************/
+float appTrajectory::Duration(void)
+{
+	return Plan.Duration;
+}
+
+/*******************************************************************************
+
+Abandons the plan, or tracking (Next() then keeps returning the target)
+
+ *******************************************************************************/
+void appTrajectory::Stop(void)
+{
+	Plan.Active = false;
+	trajTracking = false;
+}
+
+/*******************************************************************************
+
+Adds a waypoint at "pos" (deg) to the end of the queue, to be moved to at up to
+"speed" (deg/s, 0 = pidSettings.MaxSpeed).
+Returns false if the queue is full.
+
+ *******************************************************************************/
+bool appTrajectory::QueueAdd(float pos, float speed)
+{
+	if (QueueCount() >= TRAJ_QUEUE_MASK)
+		return false;
+
+	trajQueue[trajQueueHead].Pos = pos;
+	trajQueue[trajQueueHead].Speed = speed;
+	trajQueueHead = (trajQueueHead + 1) & TRAJ_QUEUE_MASK;
+
+	return true;
+}
+
+/*******************************************************************************
+
+Copies the waypoint "index" places from the front of the queue (0 = the next
+one) into "point", without taking it.
+Returns false if there is no such waypoint.
+
+ *******************************************************************************/
+bool appTrajectory::QueuePeek(byte index, ST_TRAJ_WAYPOINT * point)
+{
+	if (index >= QueueCount())
+		return false;
+
+	*point = trajQueue[(trajQueueTail + index) & TRAJ_QUEUE_MASK];
+
+	return true;
+}
+
+/*******************************************************************************
+
+Takes the next waypoint off the front of the queue into "point".
+Returns false if the queue is empty.
+
+ *******************************************************************************/
+bool appTrajectory::QueueTake(ST_TRAJ_WAYPOINT * point)
+{
+	if (!QueuePeek(0, point))
+		return false;
+
+	trajQueueTail = (trajQueueTail + 1) & TRAJ_QUEUE_MASK;
+
+	return true;
+}
+
+/*******************************************************************************
+
+The number of waypoints still waiting in the queue
+
+ *******************************************************************************/
+byte appTrajectory::QueueCount(void)
+{
+	return (trajQueueHead - trajQueueTail) & TRAJ_QUEUE_MASK;
+}
+
+/*******************************************************************************
+
+Throws away all the waypoints still waiting (the move busy now carries on)
+
+ *******************************************************************************/
+void appTrajectory::QueueClear(void)
+{
+	trajQueueTail = trajQueueHead;
+}
+
+/*******************************************************************************
+
+Starts tracking (see TrackAdd): the clock starts at 0 and all the old samples
+are thrown away. We hold still at "holdPos" (deg) until the first sample comes.
+
+ *******************************************************************************/
+void appTrajectory::TrackStart(float holdPos)
+{
+	Plan.Active = false;
+	trajTrackTail = trajTrackHead;
+	trajTrackMs = 0;
+	trajTrackTicks = 0;
+	trajTrackHold = holdPos;
+	trajTracking = true;
+}
+
+/*******************************************************************************
+
+Adds the sample that we must be at "pos" (deg) at "t" (s since TrackStart).
+Returns false if the buffer is full, or "t" is not after the last sample.
+
+ *******************************************************************************/
+bool appTrajectory::TrackAdd(float t, float pos)
+{
+unsigned long ms = TrackMs(t);
+unsigned long lastMs;
+
+	if ((t < 0.0) || (TrackCount() >= TRAJ_TRACK_MASK))
+		return false;
+
+	if ((TrackLastMs(&lastMs)) && (ms <= lastMs))
+		return false;
+
+	trajTrack[trajTrackHead].Ms = ms;
+	trajTrack[trajTrackHead].Pos = pos;
+	trajTrackHead = (trajTrackHead + 1) & TRAJ_TRACK_MASK;
+
+	return true;
+}
+
+/*******************************************************************************
+
+Returns the time "t" (s since TrackStart) as TrackAdd() keeps it (ms)
+
+ *******************************************************************************/
+unsigned long appTrajectory::TrackMs(float t)
+{
+	return (unsigned long)((t * 1000.0) + 0.5);
+}
+
+/*******************************************************************************
+
+Gets the time (ms since TrackStart) of the last sample in the buffer.
+Returns false if there is none.
+
+ *******************************************************************************/
+bool appTrajectory::TrackLastMs(unsigned long * ms)
+{
+	if (TrackCount() == 0)
+		return false;
+
+	*ms = trajTrackSample(TrackCount() - 1)->Ms;
+	return true;
+}
+
+/*******************************************************************************
+
+Stops tracking (the samples still waiting are thrown away)
+
+ *******************************************************************************/
+void appTrajectory::TrackStop(void)
+{
+	trajTracking = false;
+	trajTrackTail = trajTrackHead;
+}
+
+/*******************************************************************************
+
+Are we tracking?
+
+ *******************************************************************************/
+bool appTrajectory::Tracking(void)
+{
+	return trajTracking;
+}
+
+/*******************************************************************************
+
+The number of samples in the buffer (including the one or two just behind us)
+
+ *******************************************************************************/
+byte appTrajectory::TrackCount(void)
+{
+	return (trajTrackHead - trajTrackTail) & TRAJ_TRACK_MASK;
+}
+
+/*******************************************************************************
+
+Sets how we interpolate between the samples (TRAJ_INTERP_xxx)
+Returns the new setting
+
+ *******************************************************************************/
+byte appTrajectory::SetTrackInterp(byte interp)
+{
+	trajTrackInterp = (interp == TRAJ_INTERP_LINEAR)? TRAJ_INTERP_LINEAR : TRAJ_INTERP_HERMITE;
+
+	return trajTrackInterp;
+}
+
+/*******************************************************************************
+
+Returns how we interpolate between the samples (TRAJ_INTERP_xxx)
+
+ *******************************************************************************/
+byte appTrajectory::GetTrackInterp(void)
+{
+	return trajTrackInterp;
+}
+
+/*******************************************************************************
+
+Returns the sample "index" places from the oldest one in the buffer
+
+ *******************************************************************************/
+ST_TRAJ_SAMPLE * trajTrackSample(byte index)
+{
+	return &trajTrack[(trajTrackTail + index) & TRAJ_TRACK_MASK];
+}
+
+/*******************************************************************************
+
+Next() while tracking: moves the clock on by "ticks" and interpolates between
+the two samples either side of it... always returns true.
+
+ *******************************************************************************/
+bool trajTrackNext(unsigned long ticks, ST_TRAJ_POINT * point)
+{
+ST_TRAJ_SAMPLE * s0;
+ST_TRAJ_SAMPLE * s1;
+byte cnt;
+byte k;
+float h;		/* Time (s) from s0 to s1 */
+float u;		/* How far we are from s0 to s1 (0 to 1) */
+float slope;	/* deg/s from s0 to s1 */
+float m0, m1;	/* The slopes (deg/s) of the curve at s0 and s1 */
+
+	trajTrackTicks += ticks;
+	trajTrackMs += trajTrackTicks / TRAJ_TICKS_PER_MS;
+	trajTrackTicks %= TRAJ_TICKS_PER_MS;
+
+	//Drop the samples we are done with, but keep the one before the current
+	// pair (for the slope at s0)
+	while ((appTrajectory::TrackCount() >= 3) && (trajTrackMs >= trajTrackSample(2)->Ms))
+		trajTrackTail = (trajTrackTail + 1) & TRAJ_TRACK_MASK;
+
+	cnt = appTrajectory::TrackCount();
+	k = ((cnt >= 2) && (trajTrackMs >= trajTrackSample(1)->Ms))? 1 : 0;
+
+	point->Vel = 0.0;
+	point->Accel = 0.0;
+
+	//Nothing to go on yet, or still waiting for the first sample?
+	if ((cnt == 0) || ((k == 0) && (trajTrackMs < trajTrackSample(0)->Ms)))
+	{
+		point->Pos = (cnt == 0)? trajTrackHold : trajTrackSample(0)->Pos;
+		return true;
+	}
+
+	//Past the last sample? Then we wait there for more.
+	if ((k + 1) >= cnt)
+	{
+		point->Pos = trajTrackSample(cnt - 1)->Pos;
+		return true;
+	}
+
+	s0 = trajTrackSample(k);
+	s1 = trajTrackSample(k + 1);
+	h = ((float)(s1->Ms - s0->Ms)) / 1000.0;
+	u = (((float)(trajTrackMs - s0->Ms)) + (((float)trajTrackTicks) / TRAJ_TICKS_PER_MS)) / (h * 1000.0);
+	slope = (s1->Pos - s0->Pos) / h;
+
+	if (trajTrackInterp == TRAJ_INTERP_LINEAR)
+	{
+		point->Pos = s0->Pos + ((s1->Pos - s0->Pos) * u);
+		point->Vel = slope;
+		return true;
+	}
+
+	//The slopes either side of s0 and s1, averaged (just the slope to the
+	// next sample if there isn't one before/after)
+	m0 = slope;
+	if (k > 0)
+		m0 = 0.5 * (slope + ((s0->Pos - trajTrackSample(k - 1)->Pos) / (((float)(s0->Ms - trajTrackSample(k - 1)->Ms)) / 1000.0)));
+	m1 = slope;
+	if ((k + 2) < cnt)
+		m1 = 0.5 * (slope + ((trajTrackSample(k + 2)->Pos - s1->Pos) / (((float)(trajTrackSample(k + 2)->Ms - s1->Ms)) / 1000.0)));
+
+	//The cubic Hermite basis, and its first and second derivatives
+	point->Pos = s0->Pos +
+				 (((((2.0 * u) - 3.0) * u * u) * (s0->Pos - s1->Pos)) +
+				  ((((u - 2.0) * u) + 1.0) * u * h * m0) +
+				  (((u - 1.0) * u * u) * h * m1));
+	point->Vel = ((6.0 * (u - 1.0) * u * (s0->Pos - s1->Pos)) / h) +
+				 ((((3.0 * u) - 4.0) * u + 1.0) * m0) +
+				 (((3.0 * u) - 2.0) * u * m1);
+	point->Accel = ((6.0 * ((2.0 * u) - 1.0) * (s0->Pos - s1->Pos)) / (h * h)) +
+				   ((((6.0 * u) - 4.0) * m0) + (((6.0 * u) - 2.0) * m1)) / h;
+
+	return true;
+}
+
+#undef EXT
+/*************************** END OF FILE *************************************/
@@ -0,0 +1,119 @@
+/*****************************************************************************
+
+appTrajectory.h
+
+Include file for appTrajectory.c
+
+******************************************************************************/
+#ifndef __APPTRAJECTORY_H__
+#define __APPTRAJECTORY_H__
+
+
+/******************************************************************************
+includes
+******************************************************************************/
+#include "defines.h"
+
+/******************************************************************************
+definitions
+******************************************************************************/
+#ifdef __NOT_EXTERN__
+#define EXT
+#else
+#define EXT extern
+#endif /* __NOT_EXTERN__ */
+
+#define TRAJ_SEGMENTS_MAX	10	/* Stop (when moving away), accelerate, cruise and decelerate... 3 segments for
+									each change of speed with a jerk limit, 1 without */
+#define TRAJ_QUEUE_SIZE		8	/* Waypoints waiting to be moved to (power of 2, 8 bytes each) */
+#define TRAJ_QUEUE_MASK		(TRAJ_QUEUE_SIZE - 1)
+#define TRAJ_TRACK_SIZE		8	/* Time-tagged tracking samples (power of 2, 8 bytes each) */
+#define TRAJ_TRACK_MASK		(TRAJ_TRACK_SIZE - 1)
+
+#define TRAJ_INTERP_LINEAR	0	/* Straight lines between the tracking samples */
+#define TRAJ_INTERP_HERMITE	1	/* A cubic (Hermite) curve through them */
+
+/******************************************************************************
+Macros
+******************************************************************************/
+
+/******************************************************************************
+Struct & Unions
+******************************************************************************/
+typedef struct
+{
+	unsigned long Ticks;	/* Duration (timerUtils::tickNow() ticks) */
+	float Accel;		/* Acceleration (deg/s/s) at the start of the segment */
+	float Jerk;			/* Constant jerk (deg/s/s/s) for the whole segment */
+}ST_TRAJ_SEGMENT;	/* The position and velocity carry on from the previous segment */
+
+typedef struct
+{
+	ST_TRAJ_SEGMENT Seg[TRAJ_SEGMENTS_MAX];
+	byte SegCnt;		/* Number of segments planned */
+	byte SegIdx;		/* The segment we are busy with */
+	unsigned long SegTicks;	/* Time (ticks) into that segment */
+	float SegPos;		/* Position (deg) at the start of that segment */
+	float SegVel;		/* Velocity (deg/s) at the start of that segment */
+	float Duration;		/* Time (s) the whole move should take */
+	float Target;		/* deg */
+	float EndVel;		/* Velocity (deg/s) we pass the target with... 0 unless blending into the next waypoint */
+	bool Active;		/* Still busy with the plan */
+}ST_TRAJECTORY;
+
+typedef struct
+{
+	float Pos;			/* deg */
+	float Vel;			/* deg/s */
+	float Accel;		/* deg/s/s */
+}ST_TRAJ_POINT;	/* Where the plan wants us to be at a specific time */
+
+typedef struct
+{
+	float Pos;			/* deg */
+	float Speed;		/* The max speed (deg/s) for the move to this point, 0 = pidSettings.MaxSpeed */
+}ST_TRAJ_WAYPOINT;
+
+typedef struct
+{
+	unsigned long Ms;	/* Time since TrackStart() (ms) */
+	float Pos;			/* deg */
+}ST_TRAJ_SAMPLE;	/* Where we must be at a specific time while tracking */
+
+/******************************************************************************
+variables
+******************************************************************************/
+
+/******************************************************************************
+functions
+******************************************************************************/
+namespace appTrajectory
+{
+	EXT ST_TRAJECTORY Plan;
+
+	bool PlanMove(float startPos, float startVel, float target, float maxSpeed, float maxAccel, float maxJerk, float endSpeed);
+	float StopSpeed(float dist, float maxAccel, float maxJerk);
+	bool Next(unsigned long ticks, ST_TRAJ_POINT * point);
+	bool Active(void);
+	float Duration(void);
+	void Stop(void);
+
+	bool QueueAdd(float pos, float speed);
+	bool QueuePeek(byte index, ST_TRAJ_WAYPOINT * point);
+	bool QueueTake(ST_TRAJ_WAYPOINT * point);
+	byte QueueCount(void);
+	void QueueClear(void);
+
+	void TrackStart(float holdPos);
+	bool TrackAdd(float t, float pos);
+	unsigned long TrackMs(float t);
+	bool TrackLastMs(unsigned long * ms);
+	void TrackStop(void);
+	bool Tracking(void);
+	byte TrackCount(void);
+	byte SetTrackInterp(byte interp);
+	byte GetTrackInterp(void);
+}
+#endif /* __APPTRAJECTORY_H__ */
+
+/****************************** END OF FILE **********************************/
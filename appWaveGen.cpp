@@ -88,16 +88,18 @@ void appWaveGen::Process(void) {
 	if (!timerUtils::msTimerPoll(&waveTimer))
 		return;
 
-	timerUtils::msTimerReset (&waveTimer);
+	timerUtils::msTimerNext(&waveTimer);
 
 	//Let's do some wave generation here....
 	float time_now = ((float) (millis())) / 1000.0;
 	float levelDACoutput_f;
 	int levelDACoutput_i;
-	float position = devMotorControl::GetPosition();
+	ST_ENC_SNAPSHOT encSnap;
+	devMotorControl::GetSnapshot(&encSnap);
+	float position = devMotorControl::GetPosition(&encSnap);
 	float dacSpeed = devMotorControl::GetSpeed_DAC();
-	float encSpeed = devMotorControl::GetSpeed_ENC();
-	float avgSpeed = devMotorControl::GetSpeed_AVG();
+	float encSpeed = devMotorControl::GetSpeed_ENC(&encSnap);
+	float avgSpeed = devMotorControl::GetSpeed_AVG(&encSnap);
 	switch (waveGen.Type) {
 	case 1: 	//#### Sine waveform ####
 		levelDACoutput_f = (0.5
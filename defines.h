@@ -37,3 +37,17 @@ defines
 	#define MAIN_DEBUG
 #endif
 
+/* The "ENCODER_EDGE_ISR" define selects the edge interrupt backend for the
+ * encoder. A (INT0), X (INT1) and B (PCINT20) then interrupt on every edge,
+ * with a minimum pulse width glitch filter, instead of being polled (and
+ * debounced) from Timer2 every 200us. The CPU does no encoder work at rest and
+ * we are no longer limited to ~1250 edges/s by the polling rate. */
+//#define ENCODER_EDGE_ISR
+
+/* The "PID_FIXED_POINT" define runs the PID control step (and the conversion
+ * of its output to a DAC level) in Q16.16 fixed point instead of soft float.
+ * The float settings stay the master copy; they are converted whenever they
+ * change (see appPidControl::UpdateSettings). This is what makes a control
+ * period shorter than 10ms (down to 1ms) practical. */
+//#define PID_FIXED_POINT
+
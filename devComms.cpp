@@ -33,6 +33,7 @@ includes
 
 #include "devMotorControl.h"
 #include "appPidControl.h"
+#include "appTrajectory.h"
 
 #include "halTLC5615.h"
 #include "version.h"
@@ -92,73 +93,166 @@ const char *  ResponseMsgHeader = "[ROT-R]";
 
 ST_COMMS stDev_Comms;
 
-const ST_SETTING_ITEM SettingsArray[] = {
+const ST_SETTING_ITEM SettingsArray[] PROGMEM = {
 		// 0  RO Status Word
-		{"status",		(PARAM_READABLE),  NULL, NULL, NULL},
+		{"status",		(PARAM_READABLE),  "", "", "", 0},
 
 		// 1  RO The Actual current position relative to the startup point (startup zero)
-		{"position",	(PARAM_READABLE|PARAM_WRITABLE),  MOTOR_POS_WRAP_MIN_STR, MOTOR_POS_WRAP_MAX_STR, NULL},
+		{"position",	(PARAM_READABLE|PARAM_WRITABLE),  MOTOR_POS_WRAP_MIN_STR, MOTOR_POS_WRAP_MAX_STR, "", 0},
 //		  12345678
 		// 2  WO The Target for the PID controller to reach... setting this to a value different than position will activate the rotation and PID control
-		{"target",		(PARAM_READABLE|PARAM_WRITABLE),  MOTOR_POS_WRAP_MIN_STR, MOTOR_POS_WRAP_MAX_STR, NULL},
+		{"target",		(PARAM_READABLE|PARAM_WRITABLE),  MOTOR_POS_WRAP_MIN_STR, MOTOR_POS_WRAP_MAX_STR, "", 0},
 
 		// 3  RW The maximum speed of rotation allowed on the final drive
-		{"maxspd",		(PARAM_READABLE|PARAM_WRITABLE),  "2.0", MOTOR_SPD_ABS_MAX_STR, NULL},
+		{"maxspd",		(PARAM_READABLE|PARAM_WRITABLE),  "2.0", MOTOR_SPD_ABS_MAX_STR, "", 0},
 
 		// 4  RW The maximum speed from which the the final drivewill be allowed to "hard stop"
-		{"minspd",		(PARAM_READABLE|PARAM_WRITABLE),  MOTOR_SPD_ABS_MIN_STR, "5.0", "1.5"},
+		{"minspd",		(PARAM_READABLE|PARAM_WRITABLE),  MOTOR_SPD_ABS_MIN_STR, "5.0", "1.5", 0},
 
 		// 5  RW The maximum acceleration allowed on the final drive
-		{"maxaccel",	(PARAM_READABLE|PARAM_WRITABLE),  "36.0", "1.0", "9.0"},
+		{"maxaccel",	(PARAM_READABLE|PARAM_WRITABLE),  "1.0", "36.0", "9.0", 0},
 
 		// 6  RW PID proportional constant
-		{"kp",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "1000.0", "80.0"},
+		{"kp",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "1000.0", "80.0", 0},
 
 		// 7  RW PID integral constant
-		{"ki",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.4"},
+		{"ki",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.4", 0},
 
 		// 8  RW PID differential constant
-		{"kd",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "100.0", "2.0"},
+		{"kd",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "100.0", "2.0", 0},
 
 		// 9 RW PID interval period
-		{"period",		(PARAM_READABLE|PARAM_WRITABLE),  "0.01", "1.0", "0.01"},
+		{"period",		(PARAM_READABLE|PARAM_WRITABLE),  PID_PERIOD_MIN_STR, "1.0", "0.01", 0},
 
 		// 10 RW PID bias
-		{"bias",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.0"},
+		{"bias",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.0", 0},
 
 		// 11 RO The "distance-to-target" for the last rotation of the PID controller
-		{"dtt",			(PARAM_READABLE),  NULL, NULL, NULL},
+		{"dtt",			(PARAM_READABLE),  "", "", "", 0},
 
 		// 12 RO The "time-to-target" for the last rotation of the PID controller
-		{"ttt",			(PARAM_READABLE),  NULL, NULL, NULL},
+		{"ttt",			(PARAM_READABLE),  "", "", "", 0},
 
 		// 13 RW Offset from actual zero... only known once the zero point has been passed
-		{"offset",		(PARAM_READABLE),  "-360.0", "360.0", NULL},
+		{"offset",		(PARAM_READABLE),  "-360.0", "360.0", "", 0},
 
 		// 14 RO Real position from zero point
-		{"realpos",		(PARAM_READABLE),  NULL, NULL, NULL},
+		{"realpos",		(PARAM_READABLE),  "", "", "", 0},
 
 		// 15 RO Speed as measured on Encoder (final shaft drive)
-		{"speed",		(PARAM_READABLE),  NULL, NULL, NULL},
+		{"speed",		(PARAM_READABLE),  "", "", "", 0},
 
 		// 16 RO Average speed as calculated over the last 10 pulses rx'd from Encoded (final shaft drive)
-		{"speed_avg",	(PARAM_READABLE),  NULL, NULL, NULL},
+		{"speed_avg",	(PARAM_READABLE),  "", "", "", 0},
 
 		// 17 RO Speed as set on the DAC
-		{"speed_dac",	(PARAM_READABLE),  NULL, NULL, NULL},
+		{"speed_dac",	(PARAM_READABLE),  "", "", "", 0},
 //		  123456789
 		// 18 RW Positive quadrant Transfer function M-value (Don't f*ck around with this value unless you know what you are doing)
-		{"xfer+M",		(PARAM_READABLE|PARAM_WRITABLE),  "0.5", "10.0", XFER_EQ_POS_M_STR},
+		{"xfer+M",		(PARAM_READABLE|PARAM_WRITABLE),  "0.5", "10.0", XFER_EQ_POS_M_STR, 0},
 
 		// 19 RW Positive quadrant Transfer function C-value (Don't f*ck around with this value unless you know what you are doing)
-		{"xfer+C",		(PARAM_READABLE|PARAM_WRITABLE),  "0.5", "10.0", XFER_EQ_POS_C_STR},
+		{"xfer+C",		(PARAM_READABLE|PARAM_WRITABLE),  "0.5", "10.0", XFER_EQ_POS_C_STR, 0},
 
 		// 20 RW Negative quadrant Transfer function M-value (Don't f*ck around with this value unless you know what you are doing)
-		{"xfer-M",		(PARAM_READABLE|PARAM_WRITABLE), /* true, true, */"0.5", "10.0", XFER_EQ_NEG_M_STR},
+		{"xfer-M",		(PARAM_READABLE|PARAM_WRITABLE), /* true, true, */"0.5", "10.0", XFER_EQ_NEG_M_STR, 0},
 
 		// 21 RW Negative quadrant Transfer function C-value (Don't f*ck around with this value unless you know what you are doing)
-		{"xfer-C",		(PARAM_READABLE|PARAM_WRITABLE),  "0.5", "10.0", XFER_EQ_NEG_C_STR},
-		{NULL, 			NULL, /* false, false,*/ NULL, NULL, NULL}
+		{"xfer-C",		(PARAM_READABLE|PARAM_WRITABLE),  "0.5", "10.0", XFER_EQ_NEG_C_STR, 0},
+
+		// 22 RW Number of pulses the average speed (speed_avg) is taken over (rounded down to a power of 2)
+		{"avgwin",		(PARAM_READABLE|PARAM_WRITABLE),  "1", MOTOR_AVG_WINDOW_MAX_STR, MOTOR_AVG_WINDOW_DEF_STR, 0},
+
+		// 23 RO Total encoder counts missed, as checked on the index pulse
+		{"idx_miss",	(PARAM_READABLE),  "", "", "", 0},
+
+		// 24 RO Total extra encoder counts, as checked on the index pulse
+		{"idx_extra",	(PARAM_READABLE),  "", "", "", 0},
+
+		// 25 RO Biggest error (counts) seen over a single revolution
+		{"idx_maxerr",	(PARAM_READABLE),  "", "", "", 0},
+
+		// 26 RW Error (counts per revolution) corrected on the index pulse (0 = off)
+		{"idx_tol",		(PARAM_READABLE|PARAM_WRITABLE),  "0", INDEX_TOLERANCE_MAX_STR, "0", 0},
+
+		// 27 RO The measured time (s) between the last two PID control steps
+		{"ctl_dt",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 28 RO The biggest deviation (s) of the control step time from "period" during the last move
+		{"ctl_jit",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 29 RO The number of PID control steps missed (overruns) during the last move
+		{"ctl_ovr",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 30 RO The time (s) the current (or last) planned move should take from start to finish
+		{"plan_t",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 31 RW The maximum jerk (deg/s/s/s) of a planned move... 0 plans without a jerk limit (trapezoid)
+		{"maxjerk",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "1000.0", "0.0", 0},
+
+		// 32 RW How we interpolate between the "track" samples: 0 = linear, 1 = cubic Hermite
+		{"trk_interp",	(PARAM_READABLE|PARAM_WRITABLE),  "0", "1", "1", 0},
+
+		// 33 RW Which turn of a target azimuth (-180 to 180, "seta" only) we go to: 0 = as given, 1 = shortest travel, 2 = least cable wrap
+		{"wrap",		(PARAM_READABLE|PARAM_WRITABLE),  "0", "2", "1", 0},
+
+		// 34 RO The travel (deg) to the last target set... the sign is the direction
+		{"travel",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 35 RW Feedforward of the planned velocity into the DAC (through the Xfer model)... 0 = none, 1 = all of it
+		{"kff",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "2.0", "0.0", 0},
+
+		// 36 RW Feedforward of the planned acceleration (deg/s per deg/s/s, i.e. s)... 0 = none
+		{"kaff",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "5.0", "0.0", 0},
+
+		// 37 RW Inner velocity loop (1kHz) proportional constant... kvp and kvi both 0 = no inner loop
+		{"kvp",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.0", 0},
+
+		// 38 RW Inner velocity loop integral constant
+		{"kvi",			(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "100.0", "0.0", 0},
+
+		// 39 RW The speed (deg/s) the "autotune" relay switches between
+		{"at_relay",	(PARAM_READABLE|PARAM_WRITABLE),  "1.0", "18.0", "5.0", 0},
+
+		// 40 RW The autotune rule: 0 = Ziegler-Nichols, 1 = Tyreus-Luyben
+		{"at_rule",		(PARAM_READABLE|PARAM_WRITABLE),  "0", "1", "1", 0},
+
+		// 41 RO The ultimate gain measured by the last autotune (0 = failed)
+		{"at_ku",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 42 RO The ultimate period (s) measured by the last autotune
+		{"at_tu",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 43 RO The kvp the last autotune came up with ("autotune accept" to use it)
+		{"at_kvp",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 44 RO The kvi the last autotune came up with
+		{"at_kvi",		(PARAM_READABLE),  "", "", "", 0},
+
+		// 45 RW Gain scheduling: 0 = kp, ki and kd everywhere, 1 = the gs_xxx tables below
+		{"gs_en",		(PARAM_READABLE|PARAM_WRITABLE),  "0", "1", "0", 0},
+
+		// 46 RW gs_spd[0..3] The speeds (deg/s) of the schedule's breakpoints, from low to high
+		{"gs_spd",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", MOTOR_SPD_ABS_MAX_STR, "", GS_POINTS},
+
+		// 47 RW gs_kp+[0..3] kp at each breakpoint, moving in the positive direction
+		{"gs_kp+",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "1000.0", "80.0", GS_POINTS},
+
+		// 48 RW gs_ki+[0..3] ki at each breakpoint, positive direction
+		{"gs_ki+",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.4", GS_POINTS},
+
+		// 49 RW gs_kd+[0..3] kd at each breakpoint, positive direction
+		{"gs_kd+",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "100.0", "2.0", GS_POINTS},
+
+		// 50 RW gs_kp-[0..3] kp at each breakpoint, moving in the negative direction
+		{"gs_kp-",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "1000.0", "80.0", GS_POINTS},
+
+		// 51 RW gs_ki-[0..3] ki at each breakpoint, negative direction
+		{"gs_ki-",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "10.0", "0.4", GS_POINTS},
+
+		// 52 RW gs_kd-[0..3] kd at each breakpoint, negative direction
+		{"gs_kd-",		(PARAM_READABLE|PARAM_WRITABLE),  "0.0", "100.0", "2.0", GS_POINTS},
+		{"", 			0, /* false, false,*/ "", "", "", 0}
 };
 
 
@@ -257,16 +351,18 @@ Sets selected trace Flags
 /*******************************************************************************
 
 Reads the data on the serial port and parses the line when a carriage return is
-encountered.
+encountered. At most maxBytes are read per call.
 
  *******************************************************************************/
-void devComms::Read(void)
+void devComms::Read(int maxBytes)
 {
 	//UINT16 rxBytes, cnt;
 	//UINT16 rxCnt;
 	byte rxData;
+	int rxCnt = 0;
 
-	while (Serial.available() > 0)
+	//Do not hog the main loop... we can carry on with the rest of the bytes on the next pass
+	while ((Serial.available() > 0) && (rxCnt++ < maxBytes))
 	{
 		// read the incoming byte:
 		rxData = Serial.read();
@@ -465,6 +561,10 @@ void devComms::ParseLine(void)
 	//  "setr"			Adjust a parameter to a relative value
 	//  "calibrate"		Start the calibration procedure
 	//  "kill"			EMERGENCY STOP - (USE WITH CAUTION)
+	//  "edges"			Drain the encoder edge log
+	//  "queue"			Add waypoints to move through (see queueWaypoints)
+	//  "track"			Follow time-tagged samples (see trackSamples)
+	//  "autotune"		Tune the inner velocity loop (see runAutoTune)
 
 	if (strcasecmp("get", commandStr) == NULL)
 	{
@@ -484,6 +584,22 @@ void devComms::ParseLine(void)
 		appPidControl::StartCalibration();
 		devComms::readSetting("status");
 	}
+	else if (strcasecmp("edges", commandStr) == NULL)
+	{
+		readEdgeLog();
+	}
+	else if (strcasecmp("queue", commandStr) == NULL)
+	{
+		queueWaypoints(paramStr);
+	}
+	else if (strcasecmp("track", commandStr) == NULL)
+	{
+		trackSamples(paramStr);
+	}
+	else if (strcasecmp("autotune", commandStr) == NULL)
+	{
+		runAutoTune(paramStr);
+	}
 	else if (strcasecmp("kill", commandStr) == NULL)
 	{
 		//just kill everything.
@@ -499,6 +615,254 @@ void devComms::ParseLine(void)
 }
 /*******************************************************************************
 
+Drains up to COMMS_EDGES_PER_MSG records from the encoder edge log.
+The response looks like this:
+	edges
+	OK pend:<n>,ovf:<n>,<tick>:<state>,<tick>:<state>,...
+with the tick and state (see EDGE_LOG_xxx) in hex. "pend" is the number of
+records still waiting, so keep asking until it is 0.
+
+ *******************************************************************************/
+void devComms::readEdgeLog(void)
+{
+	ST_EDGE_RECORD edges[COMMS_EDGES_PER_MSG];
+	byte edgeCnt = devMotorControl::DrainEdgeLog(edges, COMMS_EDGES_PER_MSG);
+	int strLen;
+
+	stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "pend:%u,ovf:%u",
+			devMotorControl::GetEdgeLogCount(), devMotorControl::GetEdgeLogOverflows());
+
+	for (byte i = 0; i < edgeCnt; i++)
+	{
+		strLen = strlen(TxPayloadBuff);
+		stdUtils::TmpStrPrintf(TxPayloadBuff + strLen, TMP_STR_BUFF_SIZE - strLen, ",%lX:%02X", edges[i].Tick, edges[i].State);
+	}
+
+	CmdResponseOK(TxPayloadBuff);
+}
+/*******************************************************************************
+
+Adds waypoints to the queue, which are moved through back to back. We start
+moving to the first one straight away if we are not moving yet.
+We can expect the following type of messages:
+	queue <pos>
+	queue <pos_1>:<speed_1>,<pos_2>,...,<pos_n>:<speed_n>
+	queue clear
+	queue
+with the position in deg and the (optional) max speed in deg/s. The response
+is the number of waypoints still waiting:
+	OK queue:<n>
+Either all the waypoints are added, or none (the first invalid one is
+reported as for "seta").
+
+ *******************************************************************************/
+void devComms::queueWaypoints(char * paramStr)
+{
+	char * thisParam;
+	char curParam[21];
+	char * curValue;
+	float pos;
+	float speed;
+
+	//Are we busy calibrating?
+	if (appPidControl::ControlState != stateIDLE)
+	{
+		CmdResponseError(914, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%d", appPidControl::ControlState));
+		return;
+	}
+
+	if ((paramStr != NULL) && (strcasecmp("clear", paramStr) == NULL))
+	{
+		appTrajectory::QueueClear();
+	}
+	else if (paramStr != NULL)
+	{
+		//Is there room for all of them?
+		if ((appTrajectory::QueueCount() + countParams(paramStr)) >= TRAJ_QUEUE_SIZE)
+		{
+			CmdResponseError(913, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%d", TRAJ_QUEUE_SIZE - 1));
+			return;
+		}
+
+		//The first pass only checks every waypoint, the second adds them.
+		for (byte pass = 0; pass < 2; pass++)
+		{
+			thisParam = paramStr;
+			while (thisParam)
+			{
+				StrCopyToChar(curParam, 20, thisParam, PARAM_DELIMETER);
+				curValue = stdUtils::nextWord(curParam, true, VALUE_DELIMETER);
+
+				if ((!stdUtils::isFloatStr(curParam)) || ((curValue != NULL) && (!stdUtils::isFloatStr(curValue))))
+				{
+					CmdResponseError(910, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, (curValue)? curValue : ""));
+					return;
+				}
+				pos = atof(curParam);
+				speed = (curValue)? atof(curValue) : 0.0;
+
+				if ((pos < MOTOR_POS_WRAP_MIN) || (speed < 0.0))
+				{
+					CmdResponseError(911, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, (curValue)? curValue : ""));
+					return;
+				}
+				if ((pos > MOTOR_POS_WRAP_MAX) || (speed > MOTOR_SPD_ABS_MAX))
+				{
+					CmdResponseError(912, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, (curValue)? curValue : ""));
+					return;
+				}
+
+				if (pass > 0)
+					appTrajectory::QueueAdd(pos, speed);
+
+				//Move on to the next one, without ammending the string
+				thisParam = stdUtils::nextWord(thisParam, false, PARAM_DELIMETER);
+			}
+		}
+
+		//Off we go, if we are not moving yet
+		appPidControl::QueueStart();
+	}
+
+	CmdResponseOK(stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "queue:%u", appTrajectory::QueueCount()));
+}
+/*******************************************************************************
+
+Runs the autotune of the inner velocity loop (see appPidControl::AutoTuneStart).
+We can expect the following type of messages:
+	autotune
+	autotune accept
+	autotune abort
+The first starts the relay experiment around where we are (we must be
+standing still). Keep an eye on "status": T while it is busy, A once there are
+gains to accept ("at_kvp", "at_kvi"). "accept" writes them to "kvp" and "kvi".
+The response is the state of the controller:
+	OK autotune:<state>
+
+ *******************************************************************************/
+void devComms::runAutoTune(char * paramStr)
+{
+	bool ok;
+
+	if ((paramStr != NULL) && (strcasecmp("accept", paramStr) == NULL))
+		ok = appPidControl::AutoTuneAccept();
+	else if ((paramStr != NULL) && (strcasecmp("abort", paramStr) == NULL))
+	{
+		appPidControl::AutoTuneAbort();
+		ok = true;
+	}
+	else
+		ok = appPidControl::AutoTuneStart();
+
+	if (!ok)
+	{
+		CmdResponseError(914, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%d", appPidControl::ControlState));
+		return;
+	}
+
+	CmdResponseOK(stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "autotune:%d", appPidControl::ControlState));
+}
+/*******************************************************************************
+
+Tracking: the PID follows a curve through time-tagged samples, instead of
+moving from point to point (see appTrajectory::TrackStart). We can expect the
+following type of messages:
+	track start
+	track <t_1>:<pos_1>,<t_2>:<pos_2>,...,<t_n>:<pos_n>
+	track stop
+	track
+with the time in s since "track start" and the position in deg. Keep the
+samples coming a little ahead of time... after the last one we wait there.
+"trk_interp" sets how we get from one sample to the next. The response is the
+number of samples in the buffer:
+	OK track:<n>
+Either all the samples are added, or none (the first invalid one is reported
+as for "seta").
+
+ *******************************************************************************/
+void devComms::trackSamples(char * paramStr)
+{
+	char * thisParam;
+	char curParam[21];
+	char * curValue;
+	float t;
+	float pos;
+	unsigned long ms;
+	unsigned long lastMs;
+	bool haveLast;
+
+	if ((paramStr != NULL) && (strcasecmp("start", paramStr) == NULL))
+	{
+		if (!appPidControl::TrackStart())
+		{
+			CmdResponseError(914, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%d", appPidControl::ControlState));
+			return;
+		}
+	}
+	else if ((paramStr != NULL) && (strcasecmp("stop", paramStr) == NULL))
+	{
+		appPidControl::TrackStop();
+	}
+	else if (paramStr != NULL)
+	{
+		//Are we tracking, and is there room for all of them?
+		if ((!appTrajectory::Tracking()) ||
+			((appTrajectory::TrackCount() + countParams(paramStr)) >= TRAJ_TRACK_SIZE))
+		{
+			CmdResponseError(913, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%d", appTrajectory::TrackCount()));
+			return;
+		}
+
+		//The first pass only checks every sample, the second adds them.
+		for (byte pass = 0; pass < 2; pass++)
+		{
+			thisParam = paramStr;
+			haveLast = appTrajectory::TrackLastMs(&lastMs);
+			while (thisParam)
+			{
+				StrCopyToChar(curParam, 20, thisParam, PARAM_DELIMETER);
+				curValue = stdUtils::nextWord(curParam, true, VALUE_DELIMETER);
+
+				if ((curValue == NULL) || (!stdUtils::isFloatStr(curParam)) || (!stdUtils::isFloatStr(curValue)))
+				{
+					CmdResponseError(910, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, (curValue)? curValue : ""));
+					return;
+				}
+				t = atof(curParam);
+				pos = atof(curValue);
+
+				//The samples must be in order, after the ones we have already, to the ms
+				// that TrackAdd() keeps them to.
+				ms = appTrajectory::TrackMs(t);
+				if ((t < 0.0) || ((haveLast) && (ms <= lastMs)) || (pos < MOTOR_POS_WRAP_MIN))
+				{
+					CmdResponseError(911, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, curValue));
+					return;
+				}
+				if (pos > MOTOR_POS_WRAP_MAX)
+				{
+					CmdResponseError(912, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, curValue));
+					return;
+				}
+				lastMs = ms;
+				haveLast = true;
+
+				if ((pass > 0) && (!appPidControl::TrackAdd(t, pos)))
+				{
+					CmdResponseError(911, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, curValue));
+					return;
+				}
+
+				//Move on to the next one, without ammending the string
+				thisParam = stdUtils::nextWord(thisParam, false, PARAM_DELIMETER);
+			}
+		}
+	}
+
+	CmdResponseOK(stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "track:%u", appTrajectory::TrackCount()));
+}
+/*******************************************************************************
+
 Does the "GET" functionality of the settings
 We can expect the following type of messages:
 	get <param>
@@ -539,7 +903,7 @@ void devComms::readSetting(char * paramStr)
 		paramIndex = (stdUtils::isNaturalNumberStr(thisParam))? atoi(thisParam) : getParamIndex(thisParam);
 
 		//Add every parameter value (comma delimted) in the string.
-		valStr = getParamValueStr(paramIndex);
+		valStr = getParamValueStr(paramIndex, getParamElement(thisParam));
 		stdUtils::TmpStrPrintf(TxPayloadBuff + strLen, TMP_STR_BUFF_SIZE - strLen, "%s%c%s%s", thisParam, (byte)VALUE_DELIMETER, valStr, (paramCount>0)? ",": "");
 
 		//Get the updated string length
@@ -558,9 +922,10 @@ Does the "SET" functionality of the settings
 Checks
 
  *******************************************************************************/
-char * devComms::getParamValueStr(int paramIndex)
+char * devComms::getParamValueStr(int paramIndex, int element)
 {
 	char * retVal;
+	ST_INDEX_STATS indexStats;
 
 	switch (paramIndex)
 	{
@@ -573,7 +938,7 @@ char * devComms::getParamValueStr(int paramIndex)
 		case 6:		retVal = stdUtils::floatToStr(appPidControl::pidSettings.Kp, 3);		break;// kp
 		case 7:		retVal = stdUtils::floatToStr(appPidControl::pidSettings.Ki, 3);		break;// ki
 		case 8:		retVal = stdUtils::floatToStr(appPidControl::pidSettings.Kd, 3);		break;// kd
-		case 9:		retVal = stdUtils::floatToStr(appPidControl::pidSettings.Period, 2);	break;// Period
+		case 9:		retVal = stdUtils::floatToStr(appPidControl::pidSettings.Period, 3);	break;// Period
 		case 10:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.bias, 3);		break;// Bias
 		case 11:	retVal = stdUtils::floatToStr(abs(appPidControl::pidSettings.Target-appPidControl::pidSettings.startPos), 1);		break;// Distance-To-Target
 		case 12:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.TimeToTarget, 1);	break;// Time-To-Target
@@ -586,6 +951,37 @@ char * devComms::getParamValueStr(int paramIndex)
 		case 19:	retVal = stdUtils::floatToStr(devMotorControl::Xfer.Pos.C, 3); break; // Xfer_Pos_C
 		case 20:	retVal = stdUtils::floatToStr(devMotorControl::Xfer.Neg.M, 3);			break;// Xfer_Neg_M
 		case 21:	retVal = stdUtils::floatToStr(devMotorControl::Xfer.Neg.C, 3); break; // Xfer_Neg_C
+		case 22:	retVal = stdUtils::TmpStrPrintf("%d", devMotorControl::GetAvgWindow());	break;// avgwin
+		case 23:	devMotorControl::GetIndexStats(&indexStats); retVal = stdUtils::TmpStrPrintf("%u", indexStats.Missed);	break;// idx_miss
+		case 24:	devMotorControl::GetIndexStats(&indexStats); retVal = stdUtils::TmpStrPrintf("%u", indexStats.Extra);		break;// idx_extra
+		case 25:	devMotorControl::GetIndexStats(&indexStats); retVal = stdUtils::TmpStrPrintf("%d", indexStats.MaxErr);	break;// idx_maxerr
+		case 26:	retVal = stdUtils::TmpStrPrintf("%d", devMotorControl::GetIndexTolerance());	break;// idx_tol
+		case 27:	retVal = stdUtils::floatToStr(appPidControl::ctlStats.dt, 4);		break;// ctl_dt
+		case 28:	retVal = stdUtils::floatToStr(appPidControl::ctlStats.Jitter, 4);	break;// ctl_jit
+		case 29:	retVal = stdUtils::TmpStrPrintf("%u", appPidControl::ctlStats.Overruns);	break;// ctl_ovr
+		case 30:	retVal = stdUtils::floatToStr(appTrajectory::Duration(), 2);	break;// plan_t
+		case 31:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.MaxJerk, 2);	break;// maxjerk
+		case 32:	retVal = stdUtils::TmpStrPrintf("%d", appTrajectory::GetTrackInterp());	break;// trk_interp
+		case 33:	retVal = stdUtils::TmpStrPrintf("%d", appPidControl::GetWrapPolicy());	break;// wrap
+		case 34:	retVal = stdUtils::floatToStr(appPidControl::GetTravel(), 2);	break;// travel
+		case 35:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.Kff, 3);	break;// kff
+		case 36:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.Kaff, 3);	break;// kaff
+		case 37:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.Kvp, 3);	break;// kvp
+		case 38:	retVal = stdUtils::floatToStr(appPidControl::pidSettings.Kvi, 3);	break;// kvi
+		case 39:	retVal = stdUtils::floatToStr(appPidControl::autoTune.Relay, 2);	break;// at_relay
+		case 40:	retVal = stdUtils::TmpStrPrintf("%d", appPidControl::autoTune.Rule);	break;// at_rule
+		case 41:	retVal = stdUtils::floatToStr(appPidControl::autoTune.Ku, 3);	break;// at_ku
+		case 42:	retVal = stdUtils::floatToStr(appPidControl::autoTune.Tu, 3);	break;// at_tu
+		case 43:	retVal = stdUtils::floatToStr(appPidControl::autoTune.Kvp, 3);	break;// at_kvp
+		case 44:	retVal = stdUtils::floatToStr(appPidControl::autoTune.Kvi, 3);	break;// at_kvi
+		case 45:	retVal = stdUtils::TmpStrPrintf("%d", appPidControl::gainSchedule.Enable);	break;// gs_en
+		case 46:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Speed[element], 2);	break;// gs_spd[n]
+		case 47:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Gains[GS_DIR_POS][element].Kp, 3);	break;// gs_kp+[n]
+		case 48:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Gains[GS_DIR_POS][element].Ki, 3);	break;// gs_ki+[n]
+		case 49:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Gains[GS_DIR_POS][element].Kd, 3);	break;// gs_kd+[n]
+		case 50:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Gains[GS_DIR_NEG][element].Kp, 3);	break;// gs_kp-[n]
+		case 51:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Gains[GS_DIR_NEG][element].Ki, 3);	break;// gs_ki-[n]
+		case 52:	retVal = stdUtils::floatToStr(appPidControl::gainSchedule.Gains[GS_DIR_NEG][element].Kd, 3);	break;// gs_kd-[n]
 		default:	retVal = NULL;
 		break;
 	}
@@ -612,6 +1008,7 @@ void devComms::writeSetting(char * paramStr, bool absolute)
 	char * valStr;
 	float val_current;
 	float val_math;
+	int element;
 
 	//PrintF("SET %d params: \"%s\"\n", paramCount, paramStr);
 	//CmdResponseOK(stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "SET \"%s\"\n", paramStr));
@@ -644,9 +1041,10 @@ void devComms::writeSetting(char * paramStr, bool absolute)
 		paramIndex = (stdUtils::isNaturalNumberStr(thisParam))? atoi(thisParam) : getParamIndex(thisParam);
 
 		//Determine the final value and set it to the correct parameter
-		val_current = atof((const char *)getParamValueStr(paramIndex));
+		element = getParamElement(thisParam);
+		val_current = atof((const char *)getParamValueStr(paramIndex, element));
 		val_math = stdUtils::FloatMathStr(thisValue, val_current, absolute);
-		valStr = setParamValueStr(paramIndex, val_math);
+		valStr = setParamValueStr(paramIndex, element, val_math, absolute);
 		//PrintF("WRITE \"%s\" (%d) %s= \"%s\" (", thisParam, paramIndex, ((absolute)? "": "+"), thisValue);
 		//PrintF("%s -> ", stdUtils::floatToStr(val_current, 3));
 		//PrintF("%s", stdUtils::floatToStr(val_math, 3));
@@ -670,9 +1068,11 @@ void devComms::writeSetting(char * paramStr, bool absolute)
 
 Does the "SET" functionality of the settings
 Checks
+"absolute" is false for "setr" (finalValue is then the current value plus the
+change), which some settings treat differently (see the target).
 
  *******************************************************************************/
-char * devComms::setParamValueStr(int paramIndex, float finalValue)
+char * devComms::setParamValueStr(int paramIndex, int element, float finalValue, bool absolute)
 {
 float * dst = NULL;
 char * retVal = NULL;
@@ -685,7 +1085,8 @@ char * retVal = NULL;
 		/*The target is a special case since it should start a bunch of actions.... or should it?
 		 * Why can't we have the PID on PERMANENTLY?*/
 		case 2:
-			appPidControl::GotoPos(finalValue);
+			//Only an absolute target is an azimuth to resolve... "setr" drives to the sum as it is
+			appPidControl::GotoPos(finalValue, absolute);
 			retVal = stdUtils::floatToStr(appPidControl::pidSettings.Target, 1);
 			//dst = &appPidControl::pidSettings.Target;
 			break;// target
@@ -695,13 +1096,35 @@ char * retVal = NULL;
 		case 6:		dst = &appPidControl::pidSettings.Kp;		break;// kp
 		case 7:		dst = &appPidControl::pidSettings.Ki;		break;// ki
 		case 8:		dst = &appPidControl::pidSettings.Kd;		break;// kd
-		case 9:		dst = &appPidControl::pidSettings.Period;	break;// Period
+		case 9:		retVal = stdUtils::floatToStr(appPidControl::SetPeriod(finalValue), 3);	break;// Period
 		case 10:	dst = &appPidControl::pidSettings.bias;		break;// Bias
 
 		case 18:	dst = &devMotorControl::Xfer.Pos.M;			break;// Xfer_Pos_M
 		case 19:	dst = &devMotorControl::Xfer.Pos.C; 		break; // Xfer_Pos_C
 		case 20:	dst = &devMotorControl::Xfer.Neg.M;			break;// Xfer_Neg_M
 		case 21:	dst = &devMotorControl::Xfer.Neg.C; 		break; // Xfer_Neg_C
+		case 22:	retVal = stdUtils::TmpStrPrintf("%d", devMotorControl::SetAvgWindow((int)finalValue));	break;// avgwin
+		case 26:	retVal = stdUtils::TmpStrPrintf("%d", devMotorControl::SetIndexTolerance((int)finalValue));	break;// idx_tol
+		case 31:	dst = &appPidControl::pidSettings.MaxJerk;	break;// maxjerk
+		case 32:	retVal = stdUtils::TmpStrPrintf("%d", appTrajectory::SetTrackInterp((byte)finalValue));	break;// trk_interp
+		case 33:	retVal = stdUtils::TmpStrPrintf("%d", appPidControl::SetWrapPolicy((byte)finalValue));	break;// wrap
+		case 35:	dst = &appPidControl::pidSettings.Kff;		break;// kff
+		case 36:	dst = &appPidControl::pidSettings.Kaff;		break;// kaff
+		case 37:	dst = &appPidControl::pidSettings.Kvp;		break;// kvp
+		case 38:	dst = &appPidControl::pidSettings.Kvi;		break;// kvi
+		case 39:	dst = &appPidControl::autoTune.Relay;		break;// at_relay
+		case 40:	retVal = stdUtils::TmpStrPrintf("%d", appPidControl::SetTuneRule((byte)finalValue));	break;// at_rule
+		case 45:
+			appPidControl::gainSchedule.Enable = (finalValue != 0.0)? 1 : 0;
+			retVal = stdUtils::TmpStrPrintf("%d", appPidControl::gainSchedule.Enable);
+			break;// gs_en
+		case 46:	dst = &appPidControl::gainSchedule.Speed[element];				break;// gs_spd[n]
+		case 47:	dst = &appPidControl::gainSchedule.Gains[GS_DIR_POS][element].Kp;	break;// gs_kp+[n]
+		case 48:	dst = &appPidControl::gainSchedule.Gains[GS_DIR_POS][element].Ki;	break;// gs_ki+[n]
+		case 49:	dst = &appPidControl::gainSchedule.Gains[GS_DIR_POS][element].Kd;	break;// gs_kd+[n]
+		case 50:	dst = &appPidControl::gainSchedule.Gains[GS_DIR_NEG][element].Kp;	break;// gs_kp-[n]
+		case 51:	dst = &appPidControl::gainSchedule.Gains[GS_DIR_NEG][element].Ki;	break;// gs_ki-[n]
+		case 52:	dst = &appPidControl::gainSchedule.Gains[GS_DIR_NEG][element].Kd;	break;// gs_kd-[n]
 		default:	retVal = NULL; /* These are not writable */ break;
 	}
 
@@ -711,6 +1134,16 @@ char * retVal = NULL;
 		//We have a pointer to a float, but not one to a string yet
 		*dst = finalValue;
 		retVal = stdUtils::floatToStr(*dst, 2);
+
+		//The fixed point copies must follow
+		if ((paramIndex >= 18) && (paramIndex <= 21))
+			devMotorControl::UpdateXfer();
+		else
+		{
+			if (paramIndex == 5)
+				appPidControl::BrakeTableBuild();
+			appPidControl::UpdateSettings();
+		}
 	}
 
 	return retVal;
@@ -750,8 +1183,8 @@ bool devComms::isRdSettingsValid(char * paramString, bool absolute)
 		//Is this parameter referenced by index or by name
 		paramIndex = (stdUtils::isNaturalNumberStr(curParam))? atoi(curParam) : getParamIndex(curParam);
 
-		//Is this name/index valid (within the scope of the array)?
-		if ((paramIndex + 1) >= (sizeof(SettingsArray)/sizeof(ST_SETTING_ITEM)))
+		//Is this name/index valid (within the scope of the array), with a valid element if it is an array?
+		if (((paramIndex + 1) >= (sizeof(SettingsArray)/sizeof(ST_SETTING_ITEM))) || (!isParamElementValid(paramIndex, curParam)))
 		{
 			//Nope, we ran past the end of our settings array.
 			CmdResponseError(905, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s", curParam));
@@ -759,7 +1192,7 @@ bool devComms::isRdSettingsValid(char * paramString, bool absolute)
 		}
 
 		//Is this parameter readable (PARAM_READABLE)
-		if ((SettingsArray[paramIndex].rdwr & PARAM_READABLE) != PARAM_READABLE)
+		if ((pgm_read_byte(&SettingsArray[paramIndex].rdwr) & PARAM_READABLE) != PARAM_READABLE)
 		{
 			//No, respond with an error
 			CmdResponseError(906, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s", curParam));
@@ -799,6 +1232,7 @@ bool devComms::isWrSettingsValid(char * paramString,bool absolute)
 	char * thisParam= paramString;
 	float min, max, val;
 	char curParam[21];  // The tmp buff for copying data closer to home (into SRAM)
+	char limitStr[PARAM_VALUE_LEN + 1];  // The Min or Max of the parameter, copied out of flash
 	char * curValue;  // The tmp buff for copying data closer to home (into SRAM)
 
 	while (thisParam)
@@ -821,8 +1255,8 @@ bool devComms::isWrSettingsValid(char * paramString,bool absolute)
 		//Is this parameter referenced by index or by name
 		paramIndex = (stdUtils::isNaturalNumberStr(curParam))? atoi(curParam) : getParamIndex(curParam);
 
-		//Is this name/index valid (within the scope of the array)?
-		if ((paramIndex + 1) >= (sizeof(SettingsArray)/sizeof(ST_SETTING_ITEM)))
+		//Is this name/index valid (within the scope of the array), with a valid element if it is an array?
+		if (((paramIndex + 1) >= (sizeof(SettingsArray)/sizeof(ST_SETTING_ITEM))) || (!isParamElementValid(paramIndex, curParam)))
 		{
 			//Nope, we ran past the end of our settings array.
 			CmdResponseError(908, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s", curParam));
@@ -832,7 +1266,7 @@ bool devComms::isWrSettingsValid(char * paramString,bool absolute)
 		//PrintF("Validate SET%s \"%s\" <- \"%s\"\n", ((absolute)? "A" : "R"), curParam, curValue);
 
 		//Is this parameter writable (PARAM_WRITABLE)
-		if ((SettingsArray[paramIndex].rdwr&PARAM_WRITABLE) != PARAM_WRITABLE)
+		if ((pgm_read_byte(&SettingsArray[paramIndex].rdwr) & PARAM_WRITABLE) != PARAM_WRITABLE)
 		{
 			//No, respond with an error
 			CmdResponseError(909, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s", curParam));
@@ -845,18 +1279,20 @@ bool devComms::isWrSettingsValid(char * paramString,bool absolute)
 			CmdResponseError(910, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s", curParam, curValue));
 			return false;
 		}
-		val = atof((const char *)getParamValueStr(paramIndex));
+		val = atof((const char *)getParamValueStr(paramIndex, getParamElement(curParam)));
 		val = stdUtils::FloatMathStr(curValue, val, absolute);
 
-		//Is the value within the min an max ranges
-		if ((SettingsArray[paramIndex].Min != NULL) && (val < stdUtils::FloatMathStr(SettingsArray[paramIndex].Min, 0, true)))
+		//Is the value within the min an max ranges (the limits are in flash, so copy them out first)
+		strcpy_P(limitStr, SettingsArray[paramIndex].Min);
+		if ((limitStr[0] != 0) && (val < stdUtils::FloatMathStr(limitStr, 0, true)))
 		{
-			CmdResponseError(911, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s:%s", curParam, SettingsArray[paramIndex].Min, stdUtils::floatToStr(val, 3)));
+			CmdResponseError(911, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s:%s", curParam, limitStr, stdUtils::floatToStr(val, 3)));
 			return false;
 		}
-		if ((SettingsArray[paramIndex].Max != NULL) && (val > stdUtils::FloatMathStr(SettingsArray[paramIndex].Max, 0, true)))
+		strcpy_P(limitStr, SettingsArray[paramIndex].Max);
+		if ((limitStr[0] != 0) && (val > stdUtils::FloatMathStr(limitStr, 0, true)))
 		{
-			CmdResponseError(912, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s:%s", curParam, SettingsArray[paramIndex].Max, stdUtils::floatToStr(val, 3)));
+			CmdResponseError(912, stdUtils::TmpStrPrintf(TxPayloadBuff, TMP_STR_BUFF_SIZE, "%s:%s:%s", curParam, limitStr, stdUtils::floatToStr(val, 3)));
 			return false;
 		}
 
@@ -914,19 +1350,22 @@ int devComms::StrCopyToChar(char *dst, int len, const char *src, char delim)
 /*******************************************************************************
 
 Returns the index in the settings array of the parameter passed to the function.
-The parameter must be null-terminated.
+The parameter must be null-terminated. The element of an array parameter
+("<param>[<n>]") is not part of the name.
 
  *******************************************************************************/
 int devComms::getParamIndex(char * thisParam)
 {
 	//Start at the beginning of the settings array.
 	int paramIndex = 0;
+	char * element = strchr(thisParam, ELEMENT_DELIMETER);
+	size_t nameLen = (element)? (size_t)(element - thisParam) : strlen(thisParam);
 
 	//Check each and every parameter name in the settings array.
-	while (SettingsArray[paramIndex].Name != NULL)
+	while (pgm_read_byte(&SettingsArray[paramIndex].Name[0]) != 0)
 	{
-		//PrintF("Comparing %s with %s", SettingsArray[paramIndex].Name, thisParam);
-		if (strcasecmp(SettingsArray[paramIndex].Name, thisParam) == NULL)
+		//PrintF("Comparing %S with %s", SettingsArray[paramIndex].Name, thisParam);
+		if ((strlen_P(SettingsArray[paramIndex].Name) == nameLen) && (strncasecmp_P(thisParam, SettingsArray[paramIndex].Name, nameLen) == 0))
 		{
 			//PrintF("....Success!");
 			//We found the setting we want, now you can return this index;
@@ -942,6 +1381,43 @@ int devComms::getParamIndex(char * thisParam)
 }
 /*******************************************************************************
 
+Returns the element of an array parameter ("<param>[<n>]"), or -1 if there is
+none (or it is not a number).
+
+ *******************************************************************************/
+int devComms::getParamElement(char * thisParam)
+{
+	char elementStr[4] = "";
+	char * element = strchr(thisParam, ELEMENT_DELIMETER);
+
+	if (element == NULL)
+		return -1;
+
+	StrCopyToChar(elementStr, 3, element + 1, ']');
+	if ((elementStr[0] == 0) || (!stdUtils::isNaturalNumberStr(elementStr)) || (element[strlen(elementStr) + 1] != ']'))
+		return -1;
+
+	return atoi(elementStr);
+}
+/*******************************************************************************
+
+Array parameters must be given with an element within the array, and the rest
+without one.
+
+ *******************************************************************************/
+bool devComms::isParamElementValid(int paramIndex, char * thisParam)
+{
+	int element = getParamElement(thisParam);
+
+	byte elements = pgm_read_byte(&SettingsArray[paramIndex].Elements);
+
+	if (elements == 0)
+		return (strchr(thisParam, ELEMENT_DELIMETER) == NULL);
+
+	return ((element >= 0) && (element < elements));
+}
+/*******************************************************************************
+
 Returns the number of parameeters found starting at the passed pointer, which
 is considered to be the first parameter.
 
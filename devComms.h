@@ -30,12 +30,17 @@ definitions
 #define iPrintF(traceflags, fmt, ...) devComms::DoNothing(traceflags, PSTR(fmt), ##__VA_ARGS__) /* {	}  */
 
 #define COMMS_RX_BUFF_LEN     80 /* must be able to store the max size of string. */
+#define COMMS_EDGES_PER_MSG	   5 /* Edge log records per "edges" response (must fit in TMP_STR_BUFF_SIZE) */
+
+#define PARAM_NAME_LEN		10	/* The longest parameter name in the settings array */
+#define PARAM_VALUE_LEN		 7	/* The longest Min, Max or Default string in the settings array */
 
 #define PARAM_READABLE		0x01
 #define PARAM_WRITABLE		0x02
 
 #define PARAM_DELIMETER		','
 #define VALUE_DELIMETER		':'
+#define ELEMENT_DELIMETER	'['		/* <param>[<n>] for the elements of an array parameter */
 
 /******************************************************************************
 Macros
@@ -53,13 +58,17 @@ typedef struct
   int MsgState;		/* msIDLE, msHEADER, msMESSAGE, msCHECKSUM_H, msCHECKSUM_L, msEND */
 }ST_COMMS;
 
+/* The rows live in flash (PROGMEM) with their strings inline, so they must be
+   read with pgm_read_byte() and the *_P string functions. An empty Min or Max
+   string means no limit. */
 typedef struct
 {
-	PROGMEM char * Name;
+	char Name[PARAM_NAME_LEN + 1];
 	byte rdwr;
-	PROGMEM char * Min;
-	PROGMEM char * Max;
-	PROGMEM char * Default;
+	char Min[PARAM_VALUE_LEN + 1];
+	char Max[PARAM_VALUE_LEN + 1];
+	char Default[PARAM_VALUE_LEN + 1];
+	byte Elements;		/* The number of elements of an array parameter, 0 = not an array */
 }ST_SETTING_ITEM;
 
 typedef struct
@@ -85,7 +94,7 @@ namespace devComms
 
 	void DoNothing(int traceflags, const char *fmt, ...);
 
-	void Read(void);
+	void Read(int maxBytes);
 	int ParseByteForHeader(byte rxData);
 	int ParseByteForPayload(byte rxData);
 	int ParseByteForTail(byte rxData);
@@ -95,10 +104,14 @@ namespace devComms
 	void CmdResponseError(int errCode, const char * msg);
 
 	void readSetting(char * paramStr);
+	void readEdgeLog(void);
+	void queueWaypoints(char * paramStr);
+	void trackSamples(char * paramStr);
+	void runAutoTune(char * paramStr);
 	void writeSetting(char * paramStr, bool absolute);
 
-	char * getParamValueStr(int paramIndex);
-	char * setParamValueStr(int paramIndex, float finalValue);
+	char * getParamValueStr(int paramIndex, int element);
+	char * setParamValueStr(int paramIndex, int element, float finalValue, bool absolute);
 
 	bool isRdSettingsValid(char * paramString, bool absolute);
 	bool isWrSettingsValid(char * paramString, bool absolute);
@@ -108,6 +121,8 @@ namespace devComms
 
 	int countParams(char * thisParam);
 	int getParamIndex(char * thisParam);
+	int getParamElement(char * thisParam);
+	bool isParamElementValid(int paramIndex, char * thisParam);
 	char * getParamAtIndex(char * thisParam, int index);
 	char * getNextParam(char * thisParam);
 
@@ -287,15 +287,16 @@ char * devConsole::GetTraceName(int flagIndex)
 /*******************************************************************************
 
 Reads the data on the serial port and parses the line when a carriage return is
-encountered.
+encountered. At most maxBytes are read per call.
 
  *******************************************************************************/
-bool devConsole::Read(void)
+bool devConsole::Read(int maxBytes)
 {
 	//UINT16 rxBytes, cnt;
 	//UINT16 rxCnt;
 	byte rxData;
 	bool retVal = false;
+	int rxCnt = 0;
 
 	if (devConsole_initOK == false)
 	{
@@ -303,7 +304,8 @@ bool devConsole::Read(void)
 		return false;
 	}
 
-	while (Serial.available() > 0)
+	//Do not hog the main loop... we can carry on with the rest of the bytes on the next pass
+	while ((Serial.available() > 0) && (rxCnt++ < maxBytes))
 	{
 		// read the incoming byte:
 		rxData = Serial.read();
@@ -379,9 +381,6 @@ bool devConsole::Read(void)
 		stDev_Console.RxBuff[stDev_Console.InPtr] = 0;  // Null Terminate
 	}
 
-	//This just prints the speed and position trace if enabled
-	devMotorControl::PrintSpeedAndPosition();
-
 	return retVal;
 }
 
@@ -78,7 +78,7 @@ namespace devConsole
 	bool addMenuItem(char * ptrTag, ST_CONSOLE_LIST_ITEM * menuItem);;
 	bool addMenuItem(ST_CONSOLE_LIST_ITEM * menuItem);
 
-	bool Read(void);
+	bool Read(int maxBytes);
 	void ParseLine(void);
 
 	int paramsParse(char * paramStr, bool terminate);
@@ -93,15 +93,26 @@ includes
 #endif
 #include "version.h"
 #include "timerUtils.h"
+#include <util/atomic.h>
 
 /*******************************************************************************
 local defines
  *******************************************************************************/
-#define AMT203_DEBOUNCE_PERIOD		0.0002 /* 200us */
-#define AMT203_PULSEWIDTH_ARR_CNT	20	/* The size of the Array for averaging the speed */
+#define AMT203_PULSEWIDTH_ARR_CNT	MOTOR_AVG_WINDOW_MAX	/* The size of the Array for averaging the speed */
+#define AMT203_PULSEWIDTH_ARR_MASK	(AMT203_PULSEWIDTH_ARR_CNT - 1)
+#define EDGE_LOG_MASK				(EDGE_LOG_SIZE - 1)
+#define AMT203_TICKS_TO_DEGS		(360000000.0*TICKS_PER_US/AMT203_QUAD_PPR)	/* deg/s = this x counts/ticks */
+#define AMT203_MT_WINDOW_TICKS		(5000UL * TICKS_PER_US)	/* Minimum time span of an M/T speed measurement (5ms) */
 #define AMT203_DEBOUNCE_CNT			2	/* This will ensure that we have a
 											delay of no more than 2 x Debounce_Period */
+#define AMT203_MIN_PULSE_TICKS		(50 * TICKS_PER_US)	/* Edges on the same line closer together than this are
+											glitches (ENCODER_EDGE_ISR only). A real pulse is
+											~2.4ms wide at 36 deg/s */
 #define UNKNOWNPOS		-11377 /* as close to -999.9 deg as we can get */
+#ifdef PID_FIXED_POINT
+	#define MOTOR_SPD_ABS_MAX_Q16	((long)(MOTOR_SPD_ABS_MAX * Q16_ONE))
+	#define MOTOR_SPD_ABS_MIN_Q16	((long)(MOTOR_SPD_ABS_MIN * Q16_ONE))
+#endif /* PID_FIXED_POINT */
 
 
 /*
@@ -116,6 +127,19 @@ local defines
 
 #define ROTATE_NONE		0	/* No Rotation determined */
 
+/* All three encoder lines live on PORTD, so the ISR samples them with a single
+ * read of PIND instead of going through quickPinRead() for every pin. */
+#define AMT203_PIND_A		_BV(2)	/* Digital pin 2 (_A) */
+#define AMT203_PIND_X		_BV(3)	/* Digital pin 3 (_X) */
+#define AMT203_PIND_B		_BV(4)	/* Digital pin 4 (_B) */
+#define AMT203_PINB_OC		_BV(1)	/* Digital pin 9 (_OC) on PORTB... */
+#define DEBOUNCE_OC			_BV(0)	/* ...is debounced in bit 0 (PD0 is the UART RX) */
+#define DEBOUNCE_MASK		(AMT203_PIND_A | AMT203_PIND_X | AMT203_PIND_B | DEBOUNCE_OC)
+
+#define QUAD_AB_A			0x02	/* Bit positions of A and B in the 2-bit AB state */
+#define QUAD_AB_B			0x01
+#define QUAD_ERR			2		/* Illegal (double) transition - both A and B changed */
+
 
 //#define SetOffsetWithinLimit(z)	((z >= (AMT203_QUAD_PPR + AMT203_QUAD_PPR_NEG_OFFSET))? (z - AMT203_QUAD_PPR) : ((z < AMT203_QUAD_PPR_NEG_OFFSET)? (z + AMT203_QUAD_PPR) : z))
 #define SetOffsetWithinLimit(z)	((z < AMT203_QUAD_PPR_NEG_OFFSET)? (z + AMT203_QUAD_PPR) : ((z >= (AMT203_QUAD_PPR + AMT203_QUAD_PPR_NEG_OFFSET))? (z - AMT203_QUAD_PPR) : z ))
@@ -123,10 +147,58 @@ local defines
 /*******************************************************************************
 local function prototypes
  *******************************************************************************/
+byte sampleInputs(void);
+void edgeLogPut(unsigned long tick, byte state);
+signed char encoderDecodeAB(byte newAB);
+void encoderIndexEdge(int level);
+#ifdef ENCODER_EDGE_ISR
+void encoderEdgeAB(byte line);
+#endif /* ENCODER_EDGE_ISR */
 
 /*******************************************************************************
 local structure
  *******************************************************************************/
+typedef struct
+{
+	int Position;			/* Position at the start of the measurement window */
+	int Adjust;				/* ST_ENC_SNAPSHOT.Adjust at that position */
+	unsigned long Edge;		/* Tick count of the edge at that position */
+	float Speed;			/* The last measured speed (deg/s) */
+}ST_SPEED_MT;
+
+#ifdef PID_FIXED_POINT
+typedef struct
+{
+	long C;					/* Xfer C (deg/s), Q16.16 */
+	long K;					/* 1/(Xfer M * MOTOR_SPD_INCREMENT_FLT), Q16.16 */
+}ST_LINEAR_Q16;	/* One inverse transfer equation: DAC level = (deg/s - C) * K */
+#endif /* PID_FIXED_POINT */
+
+#ifdef ENCODER_EDGE_ISR
+typedef struct
+{
+	unsigned long LastEdge_tick;
+	unsigned long PulsePeriod_tick;
+	unsigned long ArrValue;
+	unsigned long PeriodSum;
+	int Direction;
+	byte ArrIndex;
+}ST_EDGE_UNDO;	/* What we need to take back an edge that turns out to be a glitch */
+#endif /* ENCODER_EDGE_ISR */
+
+/* Quadrature decoder, indexed with (previous AB << 2) | new AB.
+ * Counter-clockwise (forward) the AB state runs 00 -> 10 -> 11 -> 01 -> 00
+ * (A leads B), clockwise it runs the other way around. A change on both lines
+ * in the same sample is an illegal transition: we cannot tell which way we went.
+ *
+ *  prev\new	 00				 01				 10				 11		*/
+const signed char quadDecodeTable[16] PROGMEM = {
+	/* 00 */ 0,				ROTATE_BACKWARD,ROTATE_FORWARD,	QUAD_ERR,
+	/* 01 */ ROTATE_FORWARD,	0,				QUAD_ERR,		ROTATE_BACKWARD,
+	/* 10 */ ROTATE_BACKWARD,QUAD_ERR,		0,				ROTATE_FORWARD,
+	/* 11 */ QUAD_ERR,		ROTATE_FORWARD,	ROTATE_BACKWARD,0
+};
+
 #ifdef CONSOLE_MENU
 ST_CONSOLE_LIST_ITEM devMenuItem_speed 		= {NULL, "motor", 	devMotorControl::menuCmd,	"GET/SET motor control variables."};
 #endif /* CONSOLE_MENU */
@@ -154,21 +226,60 @@ bool _reversing;
 bool _enabled;
 
 //************ Variables for AMT203's input/calculations ************
-ST_PIN_DEBOUNCE debounceInput_A;
-ST_PIN_DEBOUNCE debounceInput_B;
-ST_PIN_DEBOUNCE debounceInput_X;
+ST_PORT_DEBOUNCE debounceInputs;	/* A, B and X in their PIND positions, _OC in bit 0 */
+
+volatile byte _quadState;			/* The last (debounced) AB state fed to the decoder */
+volatile unsigned int _quadErrorCount;	/* Number of illegal transitions seen by the decoder */
 
 volatile int _direction;
 volatile int _zero_offset;
 volatile int _position;
 volatile bool _ZeroOffsetIsKnown;
 
-volatile unsigned long _lastEdge_us;
-volatile unsigned long _now_us;
-volatile unsigned long _pulsePeriod_us;	//Will roll over if the pulse width is more than 71 minutes
-
-volatile unsigned long _pulsePeriod_us_arr[AMT203_PULSEWIDTH_ARR_CNT];
-volatile unsigned long _pulsePeriod_us_cnt;
+volatile unsigned long _lastEdge_tick;
+volatile unsigned long _now_tick;
+volatile unsigned long _pulsePeriod_tick;	//Will roll over if the pulse width is more than 35 minutes
+
+volatile unsigned long _pulsePeriod_tick_arr[AMT203_PULSEWIDTH_ARR_CNT];
+volatile byte _pulsePeriod_tick_cnt;
+volatile unsigned long _pulsePeriod_tick_sum;	/* Running sum of the last (1 << _avgWindowShift) periods */
+volatile byte _avgWindowShift;
+
+ST_SPEED_MT _speedMT;			/* M/T speed estimator state (main thread only) */
+
+//************ Encoder edge log (single producer: the ISR, single consumer: DrainEdgeLog) ************
+volatile ST_EDGE_RECORD _edgeLog[EDGE_LOG_SIZE];
+volatile byte _edgeLogHead;			/* Only written by the ISR */
+volatile byte _edgeLogTail;			/* Only written by DrainEdgeLog */
+volatile unsigned int _edgeLogOverflows;	/* Records dropped because the log was full */
+volatile byte _xState;				/* EDGE_LOG_X if the (debounced) zero line is high */
+
+//************ Index pulse integrity monitor ************
+volatile ST_INDEX_STATS _indexStats;
+volatile int _indexLastPos;			/* Position at the previous index (rising) edge */
+volatile bool _indexLastPosValid;	/* ...and whether we have seen one yet */
+volatile signed char _indexDir;		/* Direction we have been going since then (0 = not moved) */
+volatile bool _indexReversed;		/* ...we have turned around since then */
+volatile int _indexTolerance;		/* Auto-correct drift up to this many counts (0 = off) */
+volatile int _posAdjust;			/* Counts _position has been moved by (in total) without the motor
+									   turning: index corrections and SetPosition() */
+
+volatile byte _encGeneration;	/* Bumped (last) every time the ISR changes any of the above */
+
+#ifdef PID_FIXED_POINT
+ST_LINEAR_Q16 _xferPosQ16;		/* Xfer.Pos and Xfer.Neg, ready for SetSpeed_q16() (see UpdateXfer) */
+ST_LINEAR_Q16 _xferNegQ16;
+#endif /* PID_FIXED_POINT */
+
+#ifdef ENCODER_EDGE_ISR
+//************ Variables for the edge interrupt glitch filter ************
+volatile ST_EDGE_UNDO _glitchUndo;
+volatile byte _glitchLine;				/* The line (QUAD_AB_A/B) of the last accepted edge */
+volatile signed char _glitchStep;		/* ...the step it took */
+volatile unsigned long _glitchEdge_tick;	/* ...and when it happened */
+volatile unsigned long _indexEdge_tick;	/* The last edge on the zero line */
+volatile unsigned int _glitchCount;		/* Number of glitches filtered out */
+#endif /* ENCODER_EDGE_ISR */
 
 /*******************************************************************************
 functions
@@ -215,18 +326,26 @@ bool devMotorControl::Init(void)
 	//digitalWrite(_X, HIGH);	// activate internal pull-up resistor (when set up as input)
 
     //Save the startup states of these pins so we can start debouncing immediately.
-	debounceInput_A.DebounceCount = 0;
-	debounceInput_B.DebounceCount = 0;
-	debounceInput_X.DebounceCount = 0;
+	stdUtils::debouncePortInit(&debounceInputs, sampleInputs(), AMT203_DEBOUNCE_CNT);
 
-	debounceInput_A.CurrentState = LOW;
-	debounceInput_B.CurrentState = LOW;
-	debounceInput_X.CurrentState = LOW;
+	//...and the decoder must start from the same state (or we flag an illegal transition at startup)
+	_quadState = ((debounceInputs.State & AMT203_PIND_A)? QUAD_AB_A : 0) |
+				 ((debounceInputs.State & AMT203_PIND_B)? QUAD_AB_B : 0);
+	_quadErrorCount = 0;
+	_xState = (debounceInputs.State & AMT203_PIND_X)? EDGE_LOG_X : 0;
+	_edgeLogHead = 0;
+	_edgeLogTail = 0;
+	_edgeLogOverflows = 0;
+	_indexLastPosValid = false;
+	_indexTolerance = 0;
+
+	devMotorControl::SetAvgWindow(MOTOR_AVG_WINDOW_DEF);
 
 	Xfer.Pos.M = XFER_EQ_POS_M;
 	Xfer.Pos.C = XFER_EQ_POS_C;
 	Xfer.Neg.M = XFER_EQ_NEG_M;
 	Xfer.Neg.C = XFER_EQ_NEG_C;
+	devMotorControl::UpdateXfer();
 
 	debugPin2Level = false;
 	debugPin3Level = false;
@@ -242,12 +361,33 @@ bool devMotorControl::Init(void)
 		return false;
 	}
 
+	//Our edges are timestamped with Timer1 ticks
+	timerUtils::tickTimerInit();
+
+#ifdef ENCODER_EDGE_ISR
+	//A (INT0), X (INT1) and B (PCINT20) interrupt us on every edge, so there is
+	// no polling to be done while we are standing still.
+	_glitchLine = 0;
+	_glitchCount = 0;
+	_indexEdge_tick = timerUtils::tickNow();
+	EICRA = (EICRA & ~((1<<ISC01) | (1<<ISC11))) | (1<<ISC00) | (1<<ISC10);	//Any logical change
+	EIFR = (1<<INTF0) | (1<<INTF1);
+	EIMSK |= (1<<INT0) | (1<<INT1);
+	PCMSK2 = (1<<PCINT20);
+	PCIFR = (1<<PCIF2);
+	PCICR |= (1<<PCIE2);
+
+	//We still need Timer2 for the control tick, but there is nothing to poll
+	timerUtils::usTimerInit(NULL);
+	timerUtils::usTimerStart();
+#else
 	//We are going to check the input pins (_A, _B and _X) at 200us interval (5 kHz)
 	// in a Timer Interrupt, because we need to debounce the signal.
-	timerUtils::usTimerInit(0.0002, AMT203_DEBOUNCE_PERIOD, devMotorControl::TimerInterruptCallback);
+	timerUtils::usTimerInit(devMotorControl::TimerInterruptCallback);
 
 	//Now we can start checking our input signals...
 	timerUtils::usTimerStart();
+#endif /* ENCODER_EDGE_ISR */
 
 	// Wait for startup time (100ms) required by the encoder...
 	delay(100);
@@ -270,8 +410,10 @@ bool devMotorControl::Init(void)
 	devMotorControl::SetPosition(0.0);
 	devMotorControl::Stop();
 
-	// Initialize the use of our custom-made timers (running on Timer1)
-	timerUtils::msTimerStart(&printTraceTmr, 1000L);	//Print the Speed and Position every 1000ms
+#ifdef CONSOLE_MENU
+	// Initialize the use of our custom-made timers
+	timerUtils::msTimerAdd(&printTraceTmr, 1000L, devMotorControl::PrintSpeedAndPosition);	//Print the Speed and Position every 1000ms
+#endif /* CONSOLE_MENU */
 
 	iPrintF(trMOTOR | trALWAYS, "%sInit OK\n", devMotorControl_tag);
 
@@ -403,17 +545,28 @@ before starting rotation, or when we are sure the rotation has stopped.
  *******************************************************************************/
 void devMotorControl::ResetSpeedParams(void)
 {
-    _direction = ROTATE_NONE;//This could be dodgy... should only be done if the speed is 0
-    _now_us = micros();
-    _lastEdge_us = _now_us;
-    _pulsePeriod_us = 0l; //This insures that the startup speed is 0
+	//The encoder ISR must not see (or publish) half of this
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+	    _direction = ROTATE_NONE;//This could be dodgy... should only be done if the speed is 0
+	    _now_tick = timerUtils::tickNow();
+	    _lastEdge_tick = _now_tick;
+	    _pulsePeriod_tick = 0l; //This insures that the startup speed is 0
 
-    //_pulsePeriod_us_arr[AMT203_PULSEWIDTH_AVG];
-    _pulsePeriod_us_cnt = 0;
+	    //_pulsePeriod_tick_arr[AMT203_PULSEWIDTH_AVG];
+	    _pulsePeriod_tick_cnt = 0;
 
-    for (int i = 0; i < AMT203_PULSEWIDTH_ARR_CNT; i++)
-    	_pulsePeriod_us_arr[i] = 0l;
+	    for (int i = 0; i < AMT203_PULSEWIDTH_ARR_CNT; i++)
+	    	_pulsePeriod_tick_arr[i] = 0l;
+	    _pulsePeriod_tick_sum = 0l;
 
+	    _encGeneration++;
+
+	    _speedMT.Position = _position;
+	    _speedMT.Adjust = _posAdjust;
+	    _speedMT.Edge = _now_tick;
+	    _speedMT.Speed = 0.0;
+	}
 }
 /*******************************************************************************
 
@@ -442,6 +595,56 @@ float spdDegreePerSecond_adjust;
 
 /*******************************************************************************
 
+Takes the speed in deg/s as a Q16.16 value and does exactly what SetSpeed_degs()
+does, but in fixed point (PID_FIXED_POINT).
+Returns the DAC level set (see SetSpeed_abs).
+
+ *******************************************************************************/
+#ifdef PID_FIXED_POINT
+int devMotorControl::SetSpeed_q16(long spd)
+{
+const ST_LINEAR_Q16 * xfer;
+
+	if (spd == 0)
+		return devMotorControl::SetSpeed_abs(0);
+
+	else if (spd > MOTOR_SPD_ABS_MAX_Q16)
+		spd = MOTOR_SPD_ABS_MAX_Q16;
+
+	else if (spd < -MOTOR_SPD_ABS_MAX_Q16)
+		spd = -MOTOR_SPD_ABS_MAX_Q16;
+
+	else if ((spd > 0) && (spd < MOTOR_SPD_ABS_MIN_Q16))
+		spd = MOTOR_SPD_ABS_MIN_Q16;
+
+	else if ((spd < 0) && (spd > -MOTOR_SPD_ABS_MIN_Q16))
+		spd = -MOTOR_SPD_ABS_MIN_Q16;
+
+	xfer = (spd > 0)? &_xferPosQ16 : &_xferNegQ16;
+
+	//Q16.16 x Q16.16 >> 32 leaves the whole DAC level (rounded towards 0)
+	return devMotorControl::SetSpeed_abs((int)stdUtils::mulShift(spd - xfer->C, xfer->K, 32));
+}
+#endif /* PID_FIXED_POINT */
+
+/*******************************************************************************
+
+Converts the Xfer equations for SetSpeed_q16(). Must be called every time Xfer
+is changed (does nothing without PID_FIXED_POINT).
+
+ *******************************************************************************/
+void devMotorControl::UpdateXfer(void)
+{
+#ifdef PID_FIXED_POINT
+	_xferPosQ16.C = stdUtils::q16FromFloat(Xfer.Pos.C);
+	_xferPosQ16.K = stdUtils::q16FromFloat(1.0 / (Xfer.Pos.M * MOTOR_SPD_INCREMENT_FLT));
+	_xferNegQ16.C = stdUtils::q16FromFloat(Xfer.Neg.C);
+	_xferNegQ16.K = stdUtils::q16FromFloat(1.0 / (Xfer.Neg.M * MOTOR_SPD_INCREMENT_FLT));
+#endif /* PID_FIXED_POINT */
+}
+
+/*******************************************************************************
+
 Takes the absolute DAC level as input
 Sets the output level of the the DAC as well as the reverse output
 
@@ -486,30 +689,268 @@ void devMotorControl::KillMotor(void)
 
 /*******************************************************************************
 
+Takes a consistent copy of the encoder state shared with the ISR.
+
+The ISR bumps _encGeneration after every change, and it cannot be interrupted
+by us. So if the generation is the same before and after we copied everything,
+the ISR did not run in between and our copy is not torn. If it did run, we
+simply try again (the ISR will not run again for at least 200us).
+
+ *******************************************************************************/
+void devMotorControl::GetSnapshot(ST_ENC_SNAPSHOT * snap)
+{
+	do
+	{
+		snap->Generation = _encGeneration;
+		snap->Position = _position;
+		snap->ZeroOffset = _zero_offset;
+		snap->ZeroOffsetIsKnown = _ZeroOffsetIsKnown;
+		snap->Direction = _direction;
+		snap->PulsePeriod = _pulsePeriod_tick;
+		snap->LastEdge = _lastEdge_tick;
+		snap->Adjust = _posAdjust;
+		snap->PeriodAvg = _pulsePeriod_tick_sum >> _avgWindowShift;
+	} while (snap->Generation != _encGeneration);
+}
+
+/*******************************************************************************
+
+Copies up to maxCnt of the oldest records out of the encoder edge log (and
+frees them up for the ISR). Only one consumer may drain the log.
+
+Returns the number of records copied
+
+ *******************************************************************************/
+byte devMotorControl::DrainEdgeLog(ST_EDGE_RECORD * dst, byte maxCnt)
+{
+byte tail = _edgeLogTail;
+byte cnt = 0;
+
+	while ((cnt < maxCnt) && (tail != _edgeLogHead))
+	{
+		dst[cnt].Tick = _edgeLog[tail].Tick;
+		dst[cnt].State = _edgeLog[tail].State;
+		cnt++;
+		tail = (tail + 1) & EDGE_LOG_MASK;
+	}
+
+	//Give the slots back to the ISR
+	_edgeLogTail = tail;
+
+	return cnt;
+}
+
+/*******************************************************************************
+
+Returns the number of records waiting in the encoder edge log
+
+ *******************************************************************************/
+byte devMotorControl::GetEdgeLogCount(void)
+{
+	return (_edgeLogHead - _edgeLogTail) & EDGE_LOG_MASK;
+}
+
+/*******************************************************************************
+
+Returns the number of edge records dropped because the log was full
+
+ *******************************************************************************/
+unsigned int devMotorControl::GetEdgeLogOverflows(void)
+{
+unsigned int tmpCnt;
+
+	noInterrupts();
+	tmpCnt = _edgeLogOverflows;
+	interrupts();
+
+	return tmpCnt;
+}
+
+/*******************************************************************************
+
+Takes a copy of the index pulse integrity statistics
+
+ *******************************************************************************/
+void devMotorControl::GetIndexStats(ST_INDEX_STATS * stats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		stats->Checks = _indexStats.Checks;
+		stats->Missed = _indexStats.Missed;
+		stats->Extra = _indexStats.Extra;
+		stats->Corrected = _indexStats.Corrected;
+		stats->MaxErr = _indexStats.MaxErr;
+	}
+}
+
+/*******************************************************************************
+
+Sets the drift (in counts) per revolution that we will correct on the index
+pulse. Anything bigger is only counted (that is not drift, something is broken).
+0 turns the correction off.
+
+ *******************************************************************************/
+int devMotorControl::SetIndexTolerance(int counts)
+{
+	counts = constrain(counts, 0, INDEX_TOLERANCE_MAX);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_indexTolerance = counts;
+	}
+	return counts;
+}
+
+int devMotorControl::GetIndexTolerance(void)
+{
+int tmpTol;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		tmpTol = _indexTolerance;
+	}
+	return tmpTol;
+}
+
+/*******************************************************************************
+
+Sets the number of pulses the average speed (GetSpeed_AVG) is taken over.
+This is rounded down to a power of 2 (1 to MOTOR_AVG_WINDOW_MAX), so that the
+ISR can keep a running sum and the average is a simple shift.
+
+Returns the window actually used
+
+ *******************************************************************************/
+int devMotorControl::SetAvgWindow(int pulses)
+{
+byte shift = 0;
+unsigned long tmpSum = 0l;
+
+	pulses = constrain(pulses, 1, MOTOR_AVG_WINDOW_MAX);
+	while ((2 << shift) <= pulses)
+		shift++;
+
+	//The running sum must be rebuilt over the new window
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (int i = 1; i <= (1 << shift); i++)
+			tmpSum += _pulsePeriod_tick_arr[(_pulsePeriod_tick_cnt - i) & AMT203_PULSEWIDTH_ARR_MASK];
+
+		_pulsePeriod_tick_sum = tmpSum;
+		_avgWindowShift = shift;
+		_encGeneration++;
+	}
+
+	return (1 << shift);
+}
+
+/*******************************************************************************
+
+Returns the number of pulses the average speed is taken over
+
+ *******************************************************************************/
+int devMotorControl::GetAvgWindow(void)
+{
+	return (1 << _avgWindowShift);
+}
+
+/*******************************************************************************
+
 Returns the motor speed in deg/s as read from the shaft encoder over the last
-10 pulses received from the encoder
+GetAvgWindow() pulses received from the encoder
 
  *******************************************************************************/
 float devMotorControl::GetSpeed_AVG(void)
+{
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	return devMotorControl::GetSpeed_AVG(&snap);
+}
+
+float devMotorControl::GetSpeed_AVG(const ST_ENC_SNAPSHOT * snap)
 {
 	float tmpOmega = 0.0;
 
 	// NOTE: The recorded pulse period could be in the order of 585937 us long (@ 0.1 RPM)
 
 	//Have we picked up any speed?
-	if (_pulsePeriod_us > 0l)
+	if (snap->PulsePeriod > 0l)
 	{
 		//We need to convert the pulse width of the quadrature input(s) into
 		// angular velocity here. We know that we have 1024 pulses per rotation.
 		// Omega = (60 seconds x 10^6 x 360)/(Pulse_count_per_rotation x Tp_us x 60)
 		// Omega = (360 x 10^6)/(Pulse_count_per_rotation x Tp_us)
+		// ...and Tp_us = Tp_tick/TICKS_PER_US
 
-		//averageFloat(_pulsePeriod_us_arr, AMT203_PULSEWIDTH_AVG);
-	  //tmpOmega = (360000000.0/AMT203_QUAD_PPR)/_pulsePeriod_us;
-		tmpOmega = (360000000.0/AMT203_QUAD_PPR)/(stdUtils::avgULong(_pulsePeriod_us_arr, AMT203_PULSEWIDTH_ARR_CNT));
+		//averageFloat(_pulsePeriod_tick_arr, AMT203_PULSEWIDTH_AVG);
+	  //tmpOmega = (360000000.0/AMT203_QUAD_PPR)/_pulsePeriod_tick;
+		tmpOmega = AMT203_TICKS_TO_DEGS/snap->PeriodAvg;
 
 	}
-	return tmpOmega * ((_direction == ROTATE_BACKWARD)? ROTATE_BACKWARD : ROTATE_FORWARD);
+	return tmpOmega * ((snap->Direction == ROTATE_BACKWARD)? ROTATE_BACKWARD : ROTATE_FORWARD);
+}
+
+/*******************************************************************************
+
+Returns the motor speed in deg/s using an M/T estimator: the number of counts
+moved (M) over the exact time between the first and last edge of the
+measurement (T). At high speed many edges fall in the window, at low speed it
+reduces to the time between two edges, so we are accurate over the full range.
+
+When no new edge has arrived, we know we cannot be going faster than 1 count in
+the time since the last edge, so the speed decays with that bound and drops to
+0 once it falls below MOTOR_SPD_MT_MIN. So at rest we report 0 promptly instead
+of the period of the last pulse.
+
+The measurement window starts where the previous one ended, so only the
+control loop (PID_Process and the autotune) may move the estimator on... once
+per pass, through UpdateSpeed_MT(). Everyone else (the console, comms) only
+reads its last estimate with GetSpeed_MT(), which changes nothing.
+
+ *******************************************************************************/
+float devMotorControl::UpdateSpeed_MT(const ST_ENC_SNAPSHOT * snap)
+{
+unsigned long edgeSpan = snap->LastEdge - _speedMT.Edge;
+
+	//The position has been moved since the window started (an index correction,
+	// say) without the motor turning... so the start of the window moves with it.
+	_speedMT.Position += snap->Adjust - _speedMT.Adjust;
+	_speedMT.Adjust = snap->Adjust;
+
+	//Do we have new edges spanning a long enough window to measure?
+	if ((snap->LastEdge != _speedMT.Edge) && (edgeSpan >= AMT203_MT_WINDOW_TICKS))
+	{
+		_speedMT.Speed = (AMT203_TICKS_TO_DEGS * (snap->Position - _speedMT.Position)) / edgeSpan;
+		_speedMT.Position = snap->Position;
+		_speedMT.Edge = snap->LastEdge;
+	}
+
+	return devMotorControl::GetSpeed_MT(snap);
+}
+
+float devMotorControl::GetSpeed_MT(void)
+{
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	return devMotorControl::GetSpeed_MT(&snap);
+}
+
+float devMotorControl::GetSpeed_MT(const ST_ENC_SNAPSHOT * snap)
+{
+float spdBound;
+
+	//How fast could we be going, given the time since the last edge?
+	spdBound = AMT203_TICKS_TO_DEGS / (timerUtils::tickNow() - snap->LastEdge);
+
+	if (spdBound < MOTOR_SPD_MT_MIN)
+		return 0.0;
+
+	else if (abs(_speedMT.Speed) > spdBound)
+		return (_speedMT.Speed < 0.0)? -spdBound : spdBound;
+
+	return _speedMT.Speed;
 }
 
 /*******************************************************************************
@@ -519,23 +960,32 @@ Returns the motor speed in deg/s as read from the shaft encoder
  *******************************************************************************/
 float devMotorControl::GetSpeed_ENC(void)
 {
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	return devMotorControl::GetSpeed_ENC(&snap);
+}
+
+float devMotorControl::GetSpeed_ENC(const ST_ENC_SNAPSHOT * snap)
+{
 float tmpOmega = 0.0;
 
 	// NOTE: The recorded pulse period could be in the order of 585937 us long (@ 0.1 RPM or 0.6 deg/s)
 
 	//Have we picked up any speed?
-	if (_pulsePeriod_us > 0l)
+	if (snap->PulsePeriod > 0l)
 	{
 		//We need to convert the pulse width of the quadrature input(s) into
 		// angular velocity here. We know that we have 1024 pulses per rotation.
 		// Omega = (60 seconds x 10^6 x 360)/(Pulse_count_per_rotation x Tp_us x 60)
 		// Omega = (360 x 10^6)/(Pulse_count_per_rotation x Tp_us)
+		// ...and Tp_us = Tp_tick/TICKS_PER_US
 
-		tmpOmega = (360000000.0/AMT203_QUAD_PPR)/_pulsePeriod_us;
+		tmpOmega = AMT203_TICKS_TO_DEGS/snap->PulsePeriod;
 
 	}
 
-	return tmpOmega * ((_direction == ROTATE_BACKWARD)? ROTATE_BACKWARD : ROTATE_FORWARD);
+	return tmpOmega * ((snap->Direction == ROTATE_BACKWARD)? ROTATE_BACKWARD : ROTATE_FORWARD);
 }
 
 /*******************************************************************************
@@ -555,7 +1005,15 @@ Returns the motor position in degs
  *******************************************************************************/
 float devMotorControl::GetPosition(void)
 {
-	return (((float)_position) * MOTOR_POS_INCREMENT_DEG);
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	return devMotorControl::GetPosition(&snap);
+}
+
+float devMotorControl::GetPosition(const ST_ENC_SNAPSHOT * snap)
+{
+	return (((float)snap->Position) * MOTOR_POS_INCREMENT_DEG);
 }
 
 /*******************************************************************************
@@ -566,6 +1024,7 @@ Sets the motor Postion in deg as set on the DAC
 float devMotorControl::SetPosition(float newPos)
 {
 int realPosition;
+int tmpPos;
 	if (devMotorControl::GetSpeed_DAC() != 0)
 	{
 		iPrintF(trMOTOR | trALWAYS,
@@ -573,35 +1032,54 @@ int realPosition;
 				devMotorControl_tag,
 				stdUtils::floatToStr(devMotorControl::GetSpeed_DAC(), 2));
 	}
-	else if (_ZeroOffsetIsKnown)
+	else
 	{
-		//Now we need to set our new position and recalculate our offset
+		//The encoder ISR must not step the position while we are busy here
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			tmpPos = _position;
+			if (_ZeroOffsetIsKnown)
+			{
+				//Now we need to set our new position and recalculate our offset
 
-		//Our "real" position (wrt the correct 0) is RealPos = X_current - Z_current
-		realPosition = (_position - _zero_offset)%AMT203_QUAD_PPR;
+				//Our "real" position (wrt the correct 0) is RealPos = X_current - Z_current
+				realPosition = (_position - _zero_offset)%AMT203_QUAD_PPR;
 
-		//But we want to keep our real position in the range of -180 to 180 degrees.
-		realPosition = SetOffsetWithinLimit(realPosition);
+				//But we want to keep our real position in the range of -180 to 180 degrees.
+				realPosition = SetOffsetWithinLimit(realPosition);
 
-		//We know our "real" position... so we can set our "new" position
-		_position = (int)(roundf(newPos/MOTOR_POS_INCREMENT_DEG));
-		//_position = (int)(newPos/MOTOR_POS_INCREMENT_DEG);
+				//We know our "real" position... so we can set our "new" position
+				_position = (int)(roundf(newPos/MOTOR_POS_INCREMENT_DEG));
+				//_position = (int)(newPos/MOTOR_POS_INCREMENT_DEG);
 
-		//A "new" position will have a "new" offset, but that should remain
-		// at the same "real" position: i.e. RealPos = X_new - Z_new
-		// Thus: Z_new = X_new - RealPos
-		_zero_offset = (_position - realPosition)%AMT203_QUAD_PPR;
+				//A "new" position will have a "new" offset, but that should remain
+				// at the same "real" position: i.e. RealPos = X_new - Z_new
+				// Thus: Z_new = X_new - RealPos
+				_zero_offset = (_position - realPosition)%AMT203_QUAD_PPR;
 
-		//Now we want our new offset to be somewhere between -180 and 180 degrees.
-		_zero_offset = SetOffsetWithinLimit(_zero_offset);
-	}
-	else //if (!_ZeroOffsetIsKnown)
-	{
-		//Great, we can just set it...
-		_position = (int)(newPos/MOTOR_POS_INCREMENT_DEG);
+				//Now we want our new offset to be somewhere between -180 and 180 degrees.
+				_zero_offset = SetOffsetWithinLimit(_zero_offset);
+			}
+			else //if (!_ZeroOffsetIsKnown)
+			{
+				//Great, we can just set it...
+				_position = (int)(newPos/MOTOR_POS_INCREMENT_DEG);
+			}
+
+			//The last index position means nothing any more... the index
+			// monitor must start again from the next pulse.
+			_indexLastPosValid = false;
+			_indexDir = 0;
+			_indexReversed = false;
+
+			_posAdjust += _position - tmpPos;
+			tmpPos = _position;
+			_encGeneration++;
+		}
+		return (((float)tmpPos) * MOTOR_POS_INCREMENT_DEG);
 	}
 
-	return (((float)_position) * MOTOR_POS_INCREMENT_DEG);;
+	return devMotorControl::GetPosition();
 }
 /*******************************************************************************
 
@@ -610,10 +1088,18 @@ Returns the motor speed in deg/s as set on the DAC
  *******************************************************************************/
 float devMotorControl::GetRealPosition(void)
 {
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	return devMotorControl::GetRealPosition(&snap);
+}
+
+float devMotorControl::GetRealPosition(const ST_ENC_SNAPSHOT * snap)
+{
 int tmpPos = UNKNOWNPOS;
 	//return _position;
-	if (_ZeroOffsetIsKnown)
-		tmpPos = _position - _zero_offset;
+	if (snap->ZeroOffsetIsKnown)
+		tmpPos = snap->Position - snap->ZeroOffset;
 
 	return (((float)tmpPos) * MOTOR_POS_INCREMENT_DEG);
 }
@@ -625,15 +1111,73 @@ Returns the motor speed in deg/s as set on the DAC
  *******************************************************************************/
 float devMotorControl::GetZeroOffset(void)
 {
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	return devMotorControl::GetZeroOffset(&snap);
+}
+
+float devMotorControl::GetZeroOffset(const ST_ENC_SNAPSHOT * snap)
+{
 int tmpPos = UNKNOWNPOS;
 	//return _position;
-	if (_ZeroOffsetIsKnown)
-		tmpPos = _zero_offset;
+	if (snap->ZeroOffsetIsKnown)
+		tmpPos = snap->ZeroOffset;
 
 	return (((float)tmpPos) * MOTOR_POS_INCREMENT_DEG);
 }
 /*******************************************************************************
 
+Returns the number of illegal (double) transitions seen by the quadrature
+decoder since startup. Anything other than 0 means we have been missing edges.
+
+ *******************************************************************************/
+unsigned int devMotorControl::GetQuadErrorCount(void)
+{
+unsigned int tmpCnt;
+
+	noInterrupts();
+	tmpCnt = _quadErrorCount;
+	interrupts();
+
+	return tmpCnt;
+}
+/*******************************************************************************
+
+Returns the number of encoder edges rejected by the glitch filter since startup
+(always 0 when the encoder is polled, the debouncing takes care of it there).
+
+ *******************************************************************************/
+unsigned int devMotorControl::GetGlitchCount(void)
+{
+unsigned int tmpCnt = 0;
+
+#ifdef ENCODER_EDGE_ISR
+	noInterrupts();
+	tmpCnt = _glitchCount;
+	interrupts();
+#endif /* ENCODER_EDGE_ISR */
+
+	return tmpCnt;
+}
+/*******************************************************************************
+
+Returns true if the motor controller is flagging an over-current (_OC is active
+low). The level is debounced along with the encoder lines, unless we are
+running the edge interrupt backend, in which case we read the pin directly.
+
+ *******************************************************************************/
+bool devMotorControl::IsOverCurrent(void)
+{
+#ifdef ENCODER_EDGE_ISR
+	return (PINB & AMT203_PINB_OC)? false : true;
+#else
+	return (debounceInputs.State & DEBOUNCE_OC)? false : true;
+#endif /* ENCODER_EDGE_ISR */
+}
+
+/*******************************************************************************
+
 Returns the motor speed in deg/s as set on the DAC
 
  *******************************************************************************/
@@ -645,81 +1189,98 @@ bool devMotorControl::IsAtRealZero(void)
 
 /*******************************************************************************
 
-Timer Interrupt callback for the Encoder Input Trigger
-This callback happens about everty 100us, so do not f@#$ about in here....
-
-... get you sh!t done and get out.
+Samples all the lines we debounce into a single byte (see DEBOUNCE_MASK)
 
-And for all that is good in this earth, do not call PrintF in here!!!!
+ *******************************************************************************/
+byte sampleInputs(void)
+{
+	return (PIND & (AMT203_PIND_A | AMT203_PIND_X | AMT203_PIND_B)) |
+		   ((PINB & AMT203_PINB_OC)? DEBOUNCE_OC : 0);
+}
 
-A and B both have 1024 PPR with a 50% duty cycle and a 90 degree phase offset
-between A and B.
-             __
-X	________|  |_____________________________
-	  ____      ____      ____      ____
-A	_|    |____|    |____|    |____|    |____
-	     ____      ____      ____      ____
-B	____|    |____|    |____|    |____|    |_
+/*******************************************************************************
 
-This checks for rising AND falling edges on A AND B which effectively gives us a
-resolution of 4096
+Adds a record to the edge log. Called from interrupt context only.
+If the consumer has fallen behind, the record is dropped and counted: we never
+wait and we never overwrite what the consumer may be busy reading.
 
  *******************************************************************************/
-void devMotorControl::TimerInterruptCallback()
+void edgeLogPut(unsigned long tick, byte state)
 {
-//int pinA_lvl, pinB_lvl, pinX_lvl;
-int pinA_edge, pinB_edge, pinX_edge;
+byte next = (_edgeLogHead + 1) & EDGE_LOG_MASK;
 
-/*	we are toggling debug pin 0 to get an idea of how long the timer interrupt
-	takes to execute */
-	stdUtils::quickPinToggle(pinDEBUG_0, true);
+	if (next == _edgeLogTail)
+	{
+		_edgeLogOverflows++;
+		return;
+	}
+
+	_edgeLog[_edgeLogHead].Tick = tick;
+	_edgeLog[_edgeLogHead].State = state;
 
-	//int pinA_lvl, pinB_lvl, pinX_lvl;
+	//Only now may the consumer see it
+	_edgeLogHead = next;
+}
 
+/*******************************************************************************
+
+Feeds a new AB state to the quadrature decoder and, if we have moved, steps the
+position and measures the pulse period. Called from interrupt context only
+(either the Timer2 poll or the edge interrupts).
+
+Returns the step taken (ROTATE_FORWARD, ROTATE_BACKWARD, 0 or QUAD_ERR)
+
+ *******************************************************************************/
+signed char encoderDecodeAB(byte newAB)
+{
+signed char step;
 
-	pinA_edge = stdUtils::debounceInput(&debounceInput_A, stdUtils::quickPinRead(_A), AMT203_DEBOUNCE_CNT);
-	pinB_edge = stdUtils::debounceInput(&debounceInput_B, stdUtils::quickPinRead(_B), AMT203_DEBOUNCE_CNT);
-	pinX_edge = stdUtils::debounceInput(&debounceInput_X, stdUtils::quickPinRead(_X), AMT203_DEBOUNCE_CNT);
+	//Let the decoder table tell us which way (if any) we have moved
+	step = (signed char)pgm_read_byte(&quadDecodeTable[(_quadState << 2) | newAB]);
+	_quadState = newAB;
 
-	//Rising or falling edge on A and B should now be handled
-	if (pinA_edge || pinB_edge) //&& _PositionIsKnown)
+	if (step == QUAD_ERR)
+	{
+		//Both A and B changed since the last sample, so we have missed an edge.
+		// We have no way of knowing the direction, so we do not step, we just count it.
+		_quadErrorCount++;
+		edgeLogPut(timerUtils::tickNow(), EDGE_LOG_QUAD_ERR | _xState | newAB);
+	}
+	//Rising or falling edge on A or B should now be handled
+	else if (step != 0)
 	{
-		//Get the time of the edge on input A
-		//I know I am not supposed to call this here, but my interrupt is very
-		// short and the effect of enabling the interrupts in the micros() function
-		// *should* be negligable
-		_now_us = micros();
+		//Get the time of the edge (Timer1 ticks, safe to read in here)
+		_now_tick = timerUtils::tickNow();
+
+		edgeLogPut(_now_tick, _xState | newAB);
 
 		//Toggle debug pin 1 according to A XOR B (debounced)
-		stdUtils::quickPinToggle(pinDEBUG_1, (debounceInput_A.CurrentState == debounceInput_B.CurrentState)? false : true);
+		stdUtils::quickPinToggle(pinDEBUG_1, ((newAB == QUAD_AB_A) || (newAB == QUAD_AB_B))? true : false);
 
-		if (((pinA_edge) && (debounceInput_A.CurrentState == debounceInput_B.CurrentState)) ||
-			((pinB_edge) && (debounceInput_A.CurrentState != debounceInput_B.CurrentState)))
-			_direction = ROTATE_BACKWARD; //ROTATE_FORWARD;//
+		_direction = step;
 
-		if (((pinA_edge) && (debounceInput_A.CurrentState != debounceInput_B.CurrentState)) ||
-			((pinB_edge) && (debounceInput_A.CurrentState == debounceInput_B.CurrentState)))
-			_direction = ROTATE_FORWARD; //ROTATE_BACKWARD;//
+		//A reversal between two index pulses spoils the count for the integrity check
+		if (_indexDir == 0)
+			_indexDir = step;
+		else if (_indexDir != step)
+			_indexReversed = true;
 
 		//Calculate the pulse period on the fly
-		_pulsePeriod_us = (_now_us - _lastEdge_us);
-
-		//Should we perhaps consider averaging the pulse period over a couple of pulses?
-		//By adding the pulse period to the previous one and then dividing the result by 2 I'm
-		// actually trying to "average" the variances out a bit. This means that the delta cannot
-		// be more than 50% for any given time
-		//_pulsePeriod_us += (_now_us - _lastEdge_us);
-		//_pulsePeriod_us /= 2;
+		_pulsePeriod_tick = (_now_tick - _lastEdge_tick);
 
-		//This is an attempt to average the pulse period over AMT203_PULSEWIDTH_ARR_CNT counts
-		_pulsePeriod_us_arr[_pulsePeriod_us_cnt] = _pulsePeriod_us;
-	    _pulsePeriod_us_cnt = (_pulsePeriod_us_cnt + 1)%AMT203_PULSEWIDTH_ARR_CNT;
+		//Keep a running sum over the averaging window: add the new period and
+		// drop the one that has just fallen out of the window.
+		_pulsePeriod_tick_sum += _pulsePeriod_tick -
+			_pulsePeriod_tick_arr[(_pulsePeriod_tick_cnt - (1 << _avgWindowShift)) & AMT203_PULSEWIDTH_ARR_MASK];
+		_pulsePeriod_tick_arr[_pulsePeriod_tick_cnt] = _pulsePeriod_tick;
+	    _pulsePeriod_tick_cnt = (_pulsePeriod_tick_cnt + 1) & AMT203_PULSEWIDTH_ARR_MASK;
 
 	    //Save the micro second counter for the next rising edge
-	    _lastEdge_us = _now_us;
+	    _lastEdge_tick = _now_tick;
 
 		//Step the position on....
-    	_position +=  _direction;
+    	_position +=  step;
+    	_encGeneration++;
 
     	//It is very dangerous to WRAP here... The system should allow for some overshoot on the
     	// edges of the boundary
@@ -729,73 +1290,239 @@ int pinA_edge, pinB_edge, pinX_edge;
 		//	_position -= AMT203_QUAD_PPR_RANGE;		// Wrap to -180
 		//else if (_position <= AMT203_QUAD_PPR_WRAP_MIN)	// Or if we reach < -180 degrees
 		//	_position += AMT203_QUAD_PPR_RANGE; 		// Wrap to 540
+	}
+
+	return step;
+}
+
+/*******************************************************************************
+
+Handles an edge on the zero (index) line. Called from interrupt context only.
 
-		//Ideally, if we are at the Target Position and the speed is low enough,
-		// we want to stop right here?
-		// But then we will need viibility into the PID control here?
-		// Perhaps we can do the speed control here?
+ *******************************************************************************/
+void encoderIndexEdge(int level)
+{
+	_xState = (level == HIGH)? EDGE_LOG_X : 0;
+	edgeLogPut(timerUtils::tickNow(), EDGE_LOG_INDEX | _xState | _quadState);
+
+	//Set debug pin 2 HIGH While we are at the "real" zero
+	stdUtils::quickPinToggle(pinDEBUG_2, (level == HIGH)? true : false);
+	//We can now determine what our offset from "actual" zero is
+	_ZeroOffsetIsKnown = true;
+
+	//On a rising edge we are at real position = 0;
+	if (level == HIGH)
+	{
+		//If we have come all the way around in one direction, we must have moved
+		// exactly one revolution. Anything else means we missed (or made up) counts.
+		if ((_indexLastPosValid) && (!_indexReversed) && (_indexDir != 0))
+		{
+		int delta = _position - _indexLastPos;
+		int err = abs(delta) - AMT203_QUAD_PPR;
+
+			_indexStats.Checks++;
+			if (err < 0)
+				_indexStats.Missed -= err;
+			else
+				_indexStats.Extra += err;
+
+			if (abs(err) > abs(_indexStats.MaxErr))
+				_indexStats.MaxErr = err;
+
+			//Small enough to trust the index pulse rather than our count?
+			if ((err != 0) && (abs(err) <= _indexTolerance))
+			{
+				_position = _indexLastPos + ((delta < 0)? -AMT203_QUAD_PPR : AMT203_QUAD_PPR);
+				_posAdjust += _position - (_indexLastPos + delta);
+				_indexStats.Corrected++;
+			}
+		}
+		_indexLastPos = _position;
+		_indexLastPosValid = true;
+		_indexDir = 0;
+		_indexReversed = false;
+
+		_zero_offset = _position % AMT203_QUAD_PPR;
 	}
-	// else if ((!pinA_edge) && (!pinB_edge))
 
-	//If we get no edge for how long, then do we assume we are standing still?
+	//I suspect checking the falling edge of the zero is messing me around a bit
+
+	//On a falling edge we are at -1 (going backward) or +1 (going forward)
+	//else //if (level == LOW)
+	//	_zero_offset = (_position - _direction) % AMT203_QUAD_PPR;
+
+	//Now our offset must be somewhere between -180 and 180 degrees.
+	_zero_offset = SetOffsetWithinLimit(_zero_offset);
+	_encGeneration++;
+
+	//By redoing this calculation on every"real" zero pulse we can see if our offset
+	// will changes over time (as we miss or doubl-count pulses from the Encoder).
+	// The integrity check above keeps track of exactly that (see GetIndexStats).
+}
+
+/*******************************************************************************
+
+Timer Interrupt callback for the Encoder Input Trigger
+This callback happens about everty 200us, so do not f@#$ about in here....
+
+... get you sh!t done and get out.
+
+And for all that is good in this earth, do not call PrintF in here!!!!
+
+A and B both have 1024 PPR with a 50% duty cycle and a 90 degree phase offset
+between A and B.
+             __
+X	________|  |_____________________________
+	  ____      ____      ____      ____
+A	_|    |____|    |____|    |____|    |____
+	     ____      ____      ____      ____
+B	____|    |____|    |____|    |____|    |_
+
+This checks for rising AND falling edges on A AND B which effectively gives us a
+resolution of 4096
+
+With ENCODER_EDGE_ISR defined the encoder is serviced by the edge interrupts
+below instead, and this callback is not registered (Timer2 then only drives
+the control tick).
+
+ *******************************************************************************/
+void devMotorControl::TimerInterruptCallback()
+{
+byte changed;
+
+/*	we are toggling debug pin 0 to get an idea of how long the timer interrupt
+	takes to execute */
+	stdUtils::quickPinToggle(pinDEBUG_0, true);
+
+	//Debounce all our input lines in one go
+	changed = stdUtils::debouncePort(&debounceInputs, sampleInputs());
+
+	if (changed & (AMT203_PIND_A | AMT203_PIND_B))
+		encoderDecodeAB(((debounceInputs.State & AMT203_PIND_A)? QUAD_AB_A : 0) |
+						((debounceInputs.State & AMT203_PIND_B)? QUAD_AB_B : 0));
 
 	//Do we have an edge on the zero line.
-	if (pinX_edge)
-	{
-		//Set debug pin 2 HIGH While we are at the "real" zero (debounced)
-		stdUtils::quickPinToggle(pinDEBUG_2, (debounceInput_X.CurrentState == HIGH)? true : false);
-		//We can now determine what our offset from "actual" zero is
-		_ZeroOffsetIsKnown = true;
+	if (changed & AMT203_PIND_X)
+		encoderIndexEdge((debounceInputs.State & AMT203_PIND_X)? HIGH : LOW);
 
-		//On a rising edge we are at real position = 0;
-		if (debounceInput_X.CurrentState == HIGH)
-			_zero_offset = _position % AMT203_QUAD_PPR;
+	stdUtils::quickPinToggle(pinDEBUG_0, false);
+}
+
+#ifdef ENCODER_EDGE_ISR
+/*******************************************************************************
 
-		//I suspect checking the falling edge of the zero is messing me around a bit
+Edge interrupt backend for the encoder lines A and B.
 
-		//On a falling edge we are at -1 (going backward) or +1 (going forward)
-		//else //if (debounceInput_X.CurrentState == LOW)
-		//	_zero_offset = (_position - _direction) % AMT203_QUAD_PPR;
+A (INT0) and B (PCINT20) interrupt on every edge, so there is nothing to
+debounce: we read the port and feed the decoder directly. Instead we apply a
+minimum pulse width glitch filter. The first edge of a glitch cannot be told
+apart from a real edge, but the second (returning) edge can: it comes back on
+the same line within AMT203_MIN_PULSE_TICKS and reverses the step. The decoder
+table already cancels the position; here we also undo the period measurement
+of the first edge so a glitch does not show up as a speed spike.
 
-		//Now our offset must be somewhere between -360 and 360 degrees.
-		_zero_offset = SetOffsetWithinLimit(_zero_offset);
+ *******************************************************************************/
+void encoderEdgeAB(byte line)
+{
+unsigned long lastEdge_tick = _lastEdge_tick;
+unsigned long pulsePeriod_tick = _pulsePeriod_tick;
+unsigned long arrValue;
+unsigned long periodSum = _pulsePeriod_tick_sum;
+int direction = _direction;
+byte arrIndex;
+byte pins = PIND;	/* A and B from the same read, or we may decode a state that never was */
+signed char step;
 
-		//If our offset is equal to or above 180 degrees, move it 360 degrees back.
-		//if (_zero_offset >= (AMT203_QUAD_PPR/2))
-		//	_zero_offset -= AMT203_QUAD_PPR;
-		//Or If our offset is below 180 degrees, move it 360 degrees forward.
-		//else if (_zero_offset < (-AMT203_QUAD_PPR/2))
-		//	_zero_offset += AMT203_QUAD_PPR;
+	stdUtils::quickPinToggle(pinDEBUG_0, true);
 
-		//Now our offset can only be between -180 and 180 degrees, no?
+	//Keep what we need to undo this edge, should the next one prove it to be a glitch
+	arrIndex = _pulsePeriod_tick_cnt;
+	arrValue = _pulsePeriod_tick_arr[arrIndex];
 
-		//By redoing this calculation on every"real" zero pulse we can see if our offset
-		// will changes over time (as we miss or doubl-count pulses from the Encoder).
+	step = encoderDecodeAB(((pins & AMT203_PIND_A)? QUAD_AB_A : 0) |
+						   ((pins & AMT203_PIND_B)? QUAD_AB_B : 0));
 
-		//IMPORTAN: This could be useful to check if our debouncing is sufficient...
+	if ((step == ROTATE_FORWARD) || (step == ROTATE_BACKWARD))
+	{
+		if ((line == _glitchLine) && (step == -_glitchStep) &&
+			((_now_tick - _glitchEdge_tick) < AMT203_MIN_PULSE_TICKS))
+		{
+			//This line has bounced back too quickly... forget about the edge before this one.
+			_lastEdge_tick = _glitchUndo.LastEdge_tick;
+			_pulsePeriod_tick = _glitchUndo.PulsePeriod_tick;
+			_direction = _glitchUndo.Direction;
+			_pulsePeriod_tick_cnt = _glitchUndo.ArrIndex;
+			_pulsePeriod_tick_arr[_glitchUndo.ArrIndex] = _glitchUndo.ArrValue;
+			_pulsePeriod_tick_sum = _glitchUndo.PeriodSum;
+			_encGeneration++;
+			_glitchCount++;
+			_glitchLine = 0;
+		}
+		else
+		{
+			_glitchUndo.LastEdge_tick = lastEdge_tick;
+			_glitchUndo.PulsePeriod_tick = pulsePeriod_tick;
+			_glitchUndo.Direction = direction;
+			_glitchUndo.ArrIndex = arrIndex;
+			_glitchUndo.ArrValue = arrValue;
+			_glitchUndo.PeriodSum = periodSum;
+			_glitchLine = line;
+			_glitchStep = step;
+			_glitchEdge_tick = _now_tick;
+		}
 	}
 	stdUtils::quickPinToggle(pinDEBUG_0, false);
 }
 
+ISR(INT0_vect)
+{
+	encoderEdgeAB(QUAD_AB_A);
+}
+
+ISR(PCINT2_vect)
+{
+	//PCINT20 (B) is the only pin change interrupt enabled on this port
+	encoderEdgeAB(QUAD_AB_B);
+}
+
+/*******************************************************************************
+
+Edge interrupt backend for the zero line X (INT1).
+An edge within AMT203_MIN_PULSE_TICKS of the previous one is treated as a glitch.
+
+ *******************************************************************************/
+ISR(INT1_vect)
+{
+unsigned long now_tick = timerUtils::tickNow();
+int level = (PIND & AMT203_PIND_X)? HIGH : LOW;
+
+	if ((now_tick - _indexEdge_tick) < AMT203_MIN_PULSE_TICKS)
+		_glitchCount++;
+	else
+		encoderIndexEdge(level);
+
+	_indexEdge_tick = now_tick;
+}
+#endif /* ENCODER_EDGE_ISR */
+
 
 #ifdef CONSOLE_MENU
 /*******************************************************************************
 
-Returns the motor speed in deg/s as set on the DAC
+Prints the speed and position trace (printTraceTmr callback)
 
  *******************************************************************************/
 void devMotorControl::PrintSpeedAndPosition(void)
 {
-	if (timerUtils::msTimerPoll(&printTraceTmr))
-	{
-		iPrintF(trMOTOR, "%s", devMotorControl_tag);
-		iPrintF(trMOTOR, "P: % 8s | ", stdUtils::floatToStr(devMotorControl::GetPosition(), 3));
-		iPrintF(trMOTOR, "R: % 8s | ", stdUtils::floatToStr(devMotorControl::GetRealPosition(), 3));//GetZeroOffset(), 3));
-		iPrintF(trMOTOR, "E: % 7s | ", stdUtils::floatToStr(devMotorControl::GetSpeed_ENC() , 2));
-		iPrintF(trMOTOR, "A: % 7s | ", stdUtils::floatToStr(devMotorControl::GetSpeed_AVG() , 2));
-		iPrintF(trMOTOR, "D: % 7s\n",  stdUtils::floatToStr(devMotorControl::GetSpeed_DAC() , 2));
-		timerUtils::msTimerReset(&printTraceTmr);
-	}
+ST_ENC_SNAPSHOT snap;
+
+	devMotorControl::GetSnapshot(&snap);
+	iPrintF(trMOTOR, "%s", devMotorControl_tag);
+	iPrintF(trMOTOR, "P: % 8s | ", stdUtils::floatToStr(devMotorControl::GetPosition(&snap), 3));
+	iPrintF(trMOTOR, "R: % 8s | ", stdUtils::floatToStr(devMotorControl::GetRealPosition(&snap), 3));//GetZeroOffset(), 3));
+	iPrintF(trMOTOR, "E: % 7s | ", stdUtils::floatToStr(devMotorControl::GetSpeed_ENC(&snap) , 2));
+	iPrintF(trMOTOR, "A: % 7s | ", stdUtils::floatToStr(devMotorControl::GetSpeed_AVG(&snap) , 2));
+	iPrintF(trMOTOR, "D: % 7s\n",  stdUtils::floatToStr(devMotorControl::GetSpeed_DAC() , 2));
 }
 
 /*******************************************************************************
@@ -814,6 +1541,7 @@ char tmpStr1[10];
 bool motorStop = false;
 bool motorSpdSet = true;
 char *paramStr;
+ST_ENC_SNAPSHOT snap;
 //char *valueStr;
 
 	//PrintF("\"Speed\" called with \"%s\"\n", paramStr);
@@ -847,6 +1575,8 @@ char *paramStr;
 		if (strcasecmp(devConsole::getParam(1), "M") == NULL)
 			stdUtils::setFloatParam("Xfer+ M", "Xfer+ M", devConsole::getParam(2), &Xfer.Pos.M);
 
+		devMotorControl::UpdateXfer();
+
 		PrintF(" Xfer+ : Y = %7sX %s ", stdUtils::floatToStr(Xfer.Pos.M, 3), (Xfer.Pos.C >= 0.0)? "+" : "-");
 		PrintF(                      "%7s\n", stdUtils::floatToStr(abs(Xfer.Pos.C), 3));
 		return;
@@ -860,6 +1590,8 @@ char *paramStr;
 		if (strcasecmp(devConsole::getParam(1), "M") == NULL)
 			stdUtils::setFloatParam("Xfer- M", "Xfer- M", devConsole::getParam(2), &Xfer.Neg.M);
 
+		devMotorControl::UpdateXfer();
+
 		PrintF(" Xfer- : Y = %sX %s ", stdUtils::floatToStr(Xfer.Neg.M, 3), (Xfer.Neg.C >= 0.0)? "+" : "-");
 		PrintF(                      "%s\n", stdUtils::floatToStr(abs(Xfer.Neg.C), 3));
 		return;
@@ -872,15 +1604,14 @@ char *paramStr;
 			fltValue = 0.0;
 			if (atof(devConsole::getParam(1)) == 0.0)
 			{
-				timerUtils::msTimerStop(&printTraceTmr);
+				timerUtils::msTimerRemove(&printTraceTmr);
 				PrintF("%sTraces Stopped\n", devMotorControl_tag);
 				return;
 			}
 			else if (stdUtils::setFloatParam("Period", paramStr, devConsole::getParam(1), &fltValue, 0.5, 10) == 0)
 			{
 				//fltValue now contains the frequency... which must be converted to period in ms
-				printTraceTmr.msPeriod = (unsigned long)(1000.0 * fltValue);
-				timerUtils::msTimerReset(&printTraceTmr);
+				timerUtils::msTimerAdd(&printTraceTmr, (unsigned long)(1000.0 * fltValue), devMotorControl::PrintSpeedAndPosition);
 			}
 			else
 				return;
@@ -913,16 +1644,78 @@ char *paramStr;
 		return;
 	}
 
+	if (strcasecmp(paramStr, "Edges") == NULL)
+	{
+	ST_EDGE_RECORD edge;
+	unsigned long lastTick = 0;
+
+		PrintF("%sEdge log (%u dropped):\n", devMotorControl_tag, devMotorControl::GetEdgeLogOverflows());
+		PrintF("     Tick     dTick  A B X\n");
+		while (devMotorControl::DrainEdgeLog(&edge, 1))
+		{
+			PrintF(" %10lu %8lu  %d %d %d%s%s\n",
+					edge.Tick,
+					(lastTick)? (edge.Tick - lastTick) : 0,
+					(edge.State & 0x02)? 1 : 0,
+					(edge.State & 0x01)? 1 : 0,
+					(edge.State & EDGE_LOG_X)? 1 : 0,
+					(edge.State & EDGE_LOG_INDEX)? " IDX" : "",
+					(edge.State & EDGE_LOG_QUAD_ERR)? " ERR" : "");
+			lastTick = edge.Tick;
+		}
+		return;
+	}
+
+	if (strcasecmp(paramStr, "Index") == NULL)
+	{
+	ST_INDEX_STATS stats;
+
+		if (devConsole::paramCnt() == 2)
+		{
+			if (stdUtils::setFloatParam("Tolerance", paramStr, devConsole::getParam(1), &fltValue, 0.0, INDEX_TOLERANCE_MAX) == 0)
+				devMotorControl::SetIndexTolerance((int)fltValue);
+			else
+				return;
+		}
+		devMotorControl::GetIndexStats(&stats);
+		PrintF("%sIndex checks: %u\n", devMotorControl_tag, stats.Checks);
+		PrintF(" Missed: % 7u counts\n", stats.Missed);
+		PrintF(" Extra : % 7u counts\n", stats.Extra);
+		PrintF(" MaxErr: % 7d counts\n", stats.MaxErr);
+		PrintF(" Fixed : % 7u (tolerance %d counts)\n", stats.Corrected, devMotorControl::GetIndexTolerance());
+		return;
+	}
+
+	if (strcasecmp(paramStr, "AvgWin") == NULL)
+	{
+		if (devConsole::paramCnt() == 2)
+		{
+			if (stdUtils::setFloatParam(paramStr, paramStr, devConsole::getParam(1), &fltValue, 1.0, MOTOR_AVG_WINDOW_MAX) == 0)
+				devMotorControl::SetAvgWindow((int)fltValue);
+			else
+				return;
+		}
+		PrintF("%sAverage speed window: %d pulses\n", devMotorControl_tag, devMotorControl::GetAvgWindow());
+		return;
+	}
+
 	if (strcasecmp(paramStr, "ALL") == NULL)
 	{
+		devMotorControl::GetSnapshot(&snap);
 		PrintF("%sThe Motor Controller paramaters are:\n", devMotorControl_tag);
 		PrintF(" Period: % 6s \n", stdUtils::floatToStr((((float)printTraceTmr.msPeriod)/1000.0), 2));
-		PrintF(" Pos   : % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetPosition(), 3));
-		PrintF(" ActPos: % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetRealPosition(), 3));
-		PrintF(" Offset: % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetZeroOffset(), 3));
-		PrintF(" Speed : % 7s degs (ENC) \n", stdUtils::floatToStr(devMotorControl::GetSpeed_ENC(), 3));
-		PrintF(" Speed : % 7s degs (AVG) \n", stdUtils::floatToStr(devMotorControl::GetSpeed_AVG(), 3));
+		PrintF(" Pos   : % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetPosition(&snap), 3));
+		PrintF(" ActPos: % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetRealPosition(&snap), 3));
+		PrintF(" Offset: % 7s degs\n", stdUtils::floatToStr(devMotorControl::GetZeroOffset(&snap), 3));
+		PrintF(" Speed : % 7s degs (ENC) \n", stdUtils::floatToStr(devMotorControl::GetSpeed_ENC(&snap), 3));
+		PrintF(" Speed : % 7s degs (AVG) \n", stdUtils::floatToStr(devMotorControl::GetSpeed_AVG(&snap), 3));
+		PrintF(" Speed : % 7s degs (M/T) \n", stdUtils::floatToStr(devMotorControl::GetSpeed_MT(&snap), 3));
+		PrintF(" AvgWin: % 7d \n", devMotorControl::GetAvgWindow());
 		PrintF(" Speed : % 7s degs (SET) \n", stdUtils::floatToStr(devMotorControl::GetSpeed_DAC(), 3));
+		PrintF(" Sample: % 7lu ns\n", timerUtils::usTimerPeriod_ns());
+		PrintF(" QuadEr: % 7u \n", devMotorControl::GetQuadErrorCount());
+		PrintF(" Glitch: % 7u \n", devMotorControl::GetGlitchCount());
+		PrintF(" OvrCur: %s \n", (devMotorControl::IsOverCurrent())? "YES" : "NO");
 		PrintF(" Xfer+ : Y = %sX %s ", stdUtils::floatToStr(Xfer.Pos.M, 3), (Xfer.Pos.C >= 0.0)? "+" : "-");
 		PrintF(                      "%s\n", stdUtils::floatToStr(abs(Xfer.Pos.C), 3));
 		PrintF(" Xfer- : Y = %sX %s ", stdUtils::floatToStr(Xfer.Neg.M, 3), (Xfer.Neg.C >= 0.0)? "+" : "-");
@@ -934,8 +1727,11 @@ char *paramStr;
 	PrintF("   All       - Prints the values for all parameters\n");
 	PrintF("   Pos       - motor Position (Rd/Wr) -360.0 to 360.0\n");
 	PrintF("   Speed     - motor speed -36.0 to 36.0\n");
+	PrintF("   AvgWin    - Average speed window (Rd/Wr) 1 to 16 pulses (power of 2)\n");
 	//PrintF("   DAC       - DAC absolute value (WO) -1023 to 1023\n");
 	PrintF("   Stop      - Stops the motor\n");
+	PrintF("   Edges     - Prints (and empties) the encoder edge log\n");
+	PrintF("   Index     - Index pulse checks, correction tolerance (Rd/Wr) 0 to 64 counts\n");
 	PrintF("   Period    - Trace Frequency (Rd/Wr) 0.5 to 10 s (0 to disable)\n");
 	PrintF("   Xfer<+/-> - Pos/Neg Xfer function constants (Rd/Wr)\n");
 	PrintF("\n");
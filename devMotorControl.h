@@ -65,6 +65,22 @@ definitions
 #define MOTOR_POS_WRAP_MIN			(-540.0) /* degrees */
 #define MOTOR_POS_WRAP_MIN_STR		"-540.0" /* degrees */
 
+#define MOTOR_AVG_WINDOW_MAX		16		/* Max number of pulses the average speed is taken over (power of 2) */
+#define MOTOR_AVG_WINDOW_MAX_STR	"16"
+#define MOTOR_AVG_WINDOW_DEF		16
+#define MOTOR_AVG_WINDOW_DEF_STR	"16"
+
+#define MOTOR_SPD_MT_MIN			0.1		/* degrees per second, the M/T speed is 0 below this */
+
+#define EDGE_LOG_SIZE				16		/* Encoder edge log entries (power of 2, 5 bytes each) */
+#define EDGE_LOG_AB_MASK			0x03	/* ST_EDGE_RECORD.State: the AB state (A = 0x02, B = 0x01)... */
+#define EDGE_LOG_X					0x04	/* ...the level of the zero line */
+#define EDGE_LOG_INDEX				0x40	/* ...this was an edge on the zero line */
+#define EDGE_LOG_QUAD_ERR			0x80	/* ...this was an illegal AB transition */
+
+#define INDEX_TOLERANCE_MAX			64		/* counts, max drift we will ever auto-correct */
+#define INDEX_TOLERANCE_MAX_STR		"64"
+
 #define MOTOR_POS_INCREMENT_DEG 	(360.0/AMT203_QUAD_PPR) /* degrees */
 #define MOTOR_SPD_INCREMENT_FLT		(((float)MOTOR_SPD_ABS_MAX)/((float)TLC5615_MAX_OUTPUT_VAL))
 
@@ -122,6 +138,33 @@ Macros
 /******************************************************************************
 Struct & Unions
 ******************************************************************************/
+typedef struct
+{
+	int Position;				/* Encoder counts */
+	int ZeroOffset;				/* Encoder counts */
+	bool ZeroOffsetIsKnown;
+	int Direction;				/* ROTATE_FORWARD, ROTATE_BACKWARD or 0 */
+	unsigned long PulsePeriod;	/* Ticks between the last 2 edges */
+	unsigned long PeriodAvg;	/* Ticks, averaged over the last GetAvgWindow() edges */
+	unsigned long LastEdge;		/* Tick count of the last edge */
+	int Adjust;					/* Counts Position has been moved by without the motor turning (see _posAdjust) */
+	byte Generation;			/* Bumped by the ISR every time the encoder state changes */
+}ST_ENC_SNAPSHOT;	/* A consistent copy of the encoder state (see GetSnapshot()) */
+
+typedef struct
+{
+	unsigned long Tick;			/* When it happened (timerUtils::tickNow()) */
+	byte State;					/* EDGE_LOG_xxx flags */
+}ST_EDGE_RECORD;	/* One entry in the encoder edge log */
+
+typedef struct
+{
+	unsigned int Checks;		/* Index to index revolutions checked */
+	unsigned int Missed;		/* Total counts short of AMT203_QUAD_PPR */
+	unsigned int Extra;			/* Total counts more than AMT203_QUAD_PPR */
+	unsigned int Corrected;		/* Number of times the position was corrected */
+	int MaxErr;					/* The biggest error (counts) seen on a single revolution */
+}ST_INDEX_STATS;	/* Encoder integrity, as checked on every index pulse */
 
 /******************************************************************************
 variables
@@ -143,13 +186,37 @@ namespace devMotorControl
     void KillMotor(void);
     float SetSpeed_degs(float);
     int SetSpeed_abs(int spdAbsolute);
+#ifdef PID_FIXED_POINT
+    int SetSpeed_q16(long spd);
+#endif /* PID_FIXED_POINT */
+    void UpdateXfer(void);
+    void GetSnapshot(ST_ENC_SNAPSHOT * snap);
     float GetSpeed_ENC(void);
+    float GetSpeed_ENC(const ST_ENC_SNAPSHOT * snap);
     float GetSpeed_DAC(void);
     float GetSpeed_AVG(void);
+    float GetSpeed_AVG(const ST_ENC_SNAPSHOT * snap);
+    float UpdateSpeed_MT(const ST_ENC_SNAPSHOT * snap);
+    float GetSpeed_MT(void);
+    float GetSpeed_MT(const ST_ENC_SNAPSHOT * snap);
     float GetPosition(void);
+    float GetPosition(const ST_ENC_SNAPSHOT * snap);
     float SetPosition(float newPos);
     float GetRealPosition(void);
+    float GetRealPosition(const ST_ENC_SNAPSHOT * snap);
     float GetZeroOffset(void);
+    float GetZeroOffset(const ST_ENC_SNAPSHOT * snap);
+    unsigned int GetQuadErrorCount(void);
+    unsigned int GetGlitchCount(void);
+    bool IsOverCurrent(void);
+    byte DrainEdgeLog(ST_EDGE_RECORD * dst, byte maxCnt);
+    byte GetEdgeLogCount(void);
+    unsigned int GetEdgeLogOverflows(void);
+    void GetIndexStats(ST_INDEX_STATS * stats);
+    int SetIndexTolerance(int counts);
+    int GetIndexTolerance(void);
+    int SetAvgWindow(int pulses);
+    int GetAvgWindow(void);
     bool IsAtRealZero(void);
     void TimerInterruptCallback(void);
 
@@ -334,7 +334,8 @@ Prints the status word in binary string format
  *******************************************************************************/
 char * stdUtils::SatusWordBinStr()
 {
-	strncpy(convToStringBuff, "--", FMT_TO_STR_BUFF_SIZE);
+	strncpy(convToStringBuff, (GetStatus(statusTUNE_DONE)? "A": "-"), FMT_TO_STR_BUFF_SIZE);
+	strlcat(convToStringBuff, (GetStatus(statusTUNE_BUSY)? "T": "-"), FMT_TO_STR_BUFF_SIZE);
 	strlcat(convToStringBuff, (GetStatus(statusCALIB_BUSY)? "C": "-"), FMT_TO_STR_BUFF_SIZE);
 	strlcat(convToStringBuff, (GetStatus(statusPID_DONE)? 	"D": "-"), FMT_TO_STR_BUFF_SIZE);
 	strlcat(convToStringBuff, (GetStatus(statusPID_BUSY)? 	"B": "-"), FMT_TO_STR_BUFF_SIZE);
@@ -570,6 +571,145 @@ int stdUtils::debounceInput(ST_PIN_DEBOUNCE * input, int level, int count)
 
 /*******************************************************************************
 
+Sets up a vertical counter debouncer for 8 lines at once (i.e. a whole port).
+"level" is the startup state of the lines and "count" is the number of
+consecutive samples (1 to 4) a line must differ from its debounced state before
+we accept the change.
+
+ *******************************************************************************/
+void stdUtils::debouncePortInit(ST_PORT_DEBOUNCE * port, byte level, int count)
+{
+	count = constrain(count, 1, 4) - 1;
+
+	port->State = level;
+	port->Reload0 = (count & 0x01)? 0xFF : 0x00;
+	port->Reload1 = (count & 0x02)? 0xFF : 0x00;
+	port->Cnt0 = port->Reload0;
+	port->Cnt1 = port->Reload1;
+}
+
+/*******************************************************************************
+
+Debounces 8 lines in parallel. Each bit position has its own 2 bit down-counter,
+spread "vertically" over Cnt0 and Cnt1, so all 8 counters are stepped with a
+handful of AND/XOR operations regardless of how many lines we use.
+
+A line that differs from its debounced state counts down; when its counter is
+already at 0 the line toggles. A line that agrees is reloaded.
+
+Returns a mask of the lines that changed state on this sample.
+
+ *******************************************************************************/
+byte stdUtils::debouncePort(ST_PORT_DEBOUNCE * port, byte sample)
+{
+byte delta, toggle, run;
+
+	delta = sample ^ port->State;
+	toggle = delta & ~(port->Cnt0 | port->Cnt1);
+	run = delta & ~toggle;
+
+	//Decrement the counters still running, reload the rest
+	port->Cnt1 = (run & (port->Cnt1 ^ ~port->Cnt0)) | (~run & port->Reload1);
+	port->Cnt0 = (run & ~port->Cnt0) | (~run & port->Reload0);
+
+	port->State ^= toggle;
+
+	return toggle;
+}
+
+/*******************************************************************************
+
+Q16.16 fixed point conversions. Values outside +/-32767.99 saturate.
+
+ *******************************************************************************/
+long stdUtils::q16FromFloat(float val)
+{
+	val *= (float)Q16_ONE;
+
+	if (val >= (float)Q16_MAX)
+		return Q16_MAX;
+	if (val <= -(float)Q16_MAX)
+		return -Q16_MAX;
+
+	return (long)val;
+}
+
+float stdUtils::q16ToFloat(long val)
+{
+	return ((float)val) * (1.0 / (float)Q16_ONE);
+}
+
+/*******************************************************************************
+
+Returns (a * b) >> shift (0 to 63), rounded towards 0 and saturated to
++/-Q16_MAX.
+The full 64 bit product is built from four 16x16 bit multiplies, which the
+ATmega does in hardware, so this is much cheaper than a long long multiply.
+
+ *******************************************************************************/
+long stdUtils::mulShift(long a, long b, byte shift)
+{
+bool negative = ((a < 0) != (b < 0));
+unsigned long ua = (a < 0)? -(unsigned long)a : (unsigned long)a;
+unsigned long ub = (b < 0)? -(unsigned long)b : (unsigned long)b;
+unsigned int ah = (unsigned int)(ua >> 16);
+unsigned int al = (unsigned int)(ua & 0xFFFF);
+unsigned int bh = (unsigned int)(ub >> 16);
+unsigned int bl = (unsigned int)(ub & 0xFFFF);
+unsigned long hi, lo, mid, sum;
+
+	hi = (unsigned long)ah * bh;
+	lo = (unsigned long)al * bl;
+
+	mid = (unsigned long)ah * bl;
+	sum = lo + (mid << 16);
+	hi += (mid >> 16) + ((sum < lo)? 1 : 0);
+	lo = sum;
+
+	mid = (unsigned long)al * bh;
+	sum = lo + (mid << 16);
+	hi += (mid >> 16) + ((sum < lo)? 1 : 0);
+	lo = sum;
+
+	if (shift >= 32)
+	{
+		lo = (shift < 64)? (hi >> (shift - 32)) : 0;
+		hi = 0;
+	}
+	else if (shift > 0)
+	{
+		lo = (lo >> shift) | (hi << (32 - shift));
+		hi >>= shift;
+	}
+
+	if ((hi != 0) || (lo > (unsigned long)Q16_MAX))
+		lo = Q16_MAX;
+
+	return (negative)? -(long)lo : (long)lo;
+}
+
+long stdUtils::q16Mul(long a, long b)
+{
+	return mulShift(a, b, 16);
+}
+
+/*******************************************************************************
+
+Returns a + b, saturated to +/-Q16_MAX
+
+ *******************************************************************************/
+long stdUtils::q16Add(long a, long b)
+{
+	if ((b > 0) && (a > (Q16_MAX - b)))
+		return Q16_MAX;
+	if ((b < 0) && (a < (-Q16_MAX - b)))
+		return -Q16_MAX;
+
+	return a + b;
+}
+
+/*******************************************************************************
+
 Returns the average of all the values in the passed array
 
  *******************************************************************************/
@@ -33,6 +33,8 @@ typedef signed short s16;
 typedef signed long s32;
 
 #define sign_f(a)	((a < 0)? -1.0 : 1.0)
+#define Q16_ONE		65536l			/* 1.0 in Q16.16 fixed point */
+#define Q16_MAX		0x7FFFFFFFl		/* Fixed point results saturate at +/-Q16_MAX */
 #define INPUT_EDGE_NONE		0
 #define INPUT_EDGE_FALLING	1
 #define INPUT_EDGE_RISING	2
@@ -58,13 +60,13 @@ typedef signed long s32;
 #define statusPID_BUSY		0x08	/* Done */
 #define statusPID_DONE		0x10	/* Done */
 #define statusCALIB_BUSY	0x20 	/* Done */
-//#define status			0x40 	/* Done */
-//#define status 			0x80 	/* Done */
+#define statusTUNE_BUSY		0x40 	/* Done */
+#define statusTUNE_DONE		0x80 	/* Done */
 
 #define stateIDLE			1
 #define stateCAL_SEARCH		2
 #define stateCAL_GOTO_0		3
-//#define state			0x0
+#define stateAUTOTUNE		4
 //#define state			0x0
 //#define state			0x0
 //#define state			0x0
@@ -96,6 +98,15 @@ typedef struct
 	int DebounceCount;
 }ST_PIN_DEBOUNCE;
 
+typedef struct
+{
+	byte State;		/* The debounced level of all 8 lines */
+	byte Cnt0;		/* Vertical 2 bit down-counter... bit 0 of each line's count */
+	byte Cnt1;		/* ...and bit 1 */
+	byte Reload0;	/* Counter reload value, bit 0 (0x00 or 0xFF) */
+	byte Reload1;	/* ...and bit 1 */
+}ST_PORT_DEBOUNCE;
+
 typedef struct
 {
 	//bool States[5];
@@ -139,7 +150,14 @@ namespace stdUtils
 	void quickPinToggle(uint8_t pin, bool state);
 	int quickPinRead(uint8_t pin);
 	int debounceInput(ST_PIN_DEBOUNCE * input, int level, int count);
+	void debouncePortInit(ST_PORT_DEBOUNCE * port, byte level, int count);
+	byte debouncePort(ST_PORT_DEBOUNCE * port, byte sample);
 	unsigned long avgULong(volatile unsigned long * arr, int cnt);
+	long q16FromFloat(float val);
+	float q16ToFloat(long val);
+	long mulShift(long a, long b, byte shift);
+	long q16Add(long a, long b);
+	long q16Mul(long a, long b);
 	int freeRam (void);
 
 	byte crc8_str(const char *str);
@@ -0,0 +1,449 @@
+/*****************************************************************************
+
+pid_q16_test.cpp
+
+Checks the fixed point control step (PID_FIXED_POINT) against the float one,
+on the host (see the Makefile). The same source is built twice, once for each
+step, and run in three passes:
+
+record	(float build) Drives a simulated motor (a first order lag on the DAC
+		speed) through a set of random moves with random settings, closed loop,
+		and writes down everything a control step depends on: the settings, the
+		encoder and the clock for every step, and the state the step starts from.
+replay	(either build) Runs every recorded step again from exactly that input
+		and state, and writes down the DAC level and the speed it came up with.
+compare	Checks that the float replay gives back the recording (the harness is
+		deterministic), and that the fixed point step is within 1 DAC level of
+		the float one. Below MOTOR_SPD_ABS_MIN the DAC snaps to +/-MinSpd, so a
+		sign flip in the last bit is a jump of the whole MinSpd there... these
+		steps are counted, but not checked.
+
+Returns 0 if all is well, 1 if not.
+
+******************************************************************************/
+#include "Arduino.h"
+#include "defines.h"
+#include "stdUtils.h"
+#include "timerUtils.h"
+#include "devMotorControl.h"
+#include "appTrajectory.h"
+#include "appPidControl.h"
+
+/******************************************************************************
+definitions
+******************************************************************************/
+#define SIM_MOVES			24			/* Moves recorded per run */
+#define SIM_MOVE_TIME_MAX	30.0		/* s, we give up on a move after this */
+#define SIM_PLANT_TAU		0.08		/* s, time constant of the motor */
+#define SIM_SUBSTEP_TICKS	(100 * TICKS_PER_US)	/* The plant is run in 100us steps */
+#define SIM_JITTER			0.02		/* Each period is up to this much (of it) short or long */
+#define SIM_POS_MAX			400.0		/* deg, we keep the targets within +/- this */
+
+#define DAC_DIFF_MAX		1			/* DAC levels the fixed point step may be out by */
+#define SNAP_MARGIN			0.01		/* deg/s, either side of MOTOR_SPD_ABS_MIN that may snap */
+
+/* The settings of a move, in the order they are recorded */
+enum {	setPeriod, setKp, setKi, setKd, setMaxAccel, setMaxSpeed, setMinSpeed, setMaxJerk, setKff, setKaff,
+		setGsEnable, setGsSpeed, setGsGains = setGsSpeed + GS_POINTS, setTarget = setGsGains + (2 * GS_POINTS * 3),
+		setCount };
+
+/******************************************************************************
+the firmware's own state (not in its headers)
+******************************************************************************/
+extern volatile unsigned int _tickOverflows;
+extern volatile int _position;
+extern volatile unsigned long _lastEdge_tick;
+extern bool _reversing;
+extern float pidFeedFwd;
+#ifdef PID_FIXED_POINT
+extern ST_PID_Q16 pidFixed;
+#endif /* PID_FIXED_POINT */
+
+extern unsigned long shimMillis;
+extern unsigned int shimDacLevel;
+
+/******************************************************************************
+local variables
+******************************************************************************/
+uint32_t simSeed = 12345;
+unsigned long simTick;
+
+/*******************************************************************************
+
+A random number from "lo" to "hi" (the same ones every run)
+
+ *******************************************************************************/
+float simRand(float lo, float hi)
+{
+	simSeed = (simSeed * 1664525u) + 1013904223u;
+	return lo + ((hi - lo) * ((float)(simSeed >> 8) / 16777216.0f));
+}
+
+/*******************************************************************************
+
+Sets the tick timer and millis() to "tick"
+
+ *******************************************************************************/
+void simSetClock(unsigned long tick)
+{
+	simTick = tick;
+	_tickOverflows = (unsigned int)(tick >> 16);
+	TCNT1 = (uint16_t)(tick & 0xFFFF);
+	TIFR1 = 0;
+	shimMillis = tick / (1000 * TICKS_PER_US);
+}
+
+/*******************************************************************************
+
+The level on the DAC, negative if we are reversing
+
+ *******************************************************************************/
+int simDacLevel(void)
+{
+	return (_reversing)? -(int)shimDacLevel : (int)shimDacLevel;
+}
+
+/*******************************************************************************
+
+Picks the settings (and target) of the next move, starting from "pos" (deg)
+
+ *******************************************************************************/
+void simPickMove(float * set, float period, float pos)
+{
+float target;
+
+	set[setPeriod] = period;
+	set[setKp] = 80.0 * simRand(0.25, 1.5);
+	set[setKi] = 0.4 * simRand(0.0, 2.0);
+	set[setKd] = 2.0 * simRand(0.0, 1.5);
+	set[setMaxAccel] = simRand(5.0, 36.0);
+	set[setMaxSpeed] = simRand(5.0, MOTOR_SPD_ABS_MAX);
+	set[setMinSpeed] = 1.0;
+	set[setMaxJerk] = (simRand(0, 1) < 0.5)? 0.0 : simRand(40.0, 400.0);
+	set[setKff] = (simRand(0, 1) < 0.5)? 0.0 : simRand(0.8, 1.0);
+	set[setKaff] = (simRand(0, 1) < 0.5)? 0.0 : simRand(0.0, 0.05);
+
+	set[setGsEnable] = (simRand(0, 1) < 0.5)? 0.0 : 1.0;
+	set[setGsSpeed + 0] = 0.0;
+	set[setGsSpeed + 1] = simRand(1.0, 4.0);
+	set[setGsSpeed + 2] = simRand(6.0, 15.0);
+	set[setGsSpeed + 3] = MOTOR_SPD_ABS_MAX;
+	for (int i = 0; i < (2 * GS_POINTS); i++)
+	{
+		set[setGsGains + (i * 3) + 0] = set[setKp] * simRand(0.5, 1.5);
+		set[setGsGains + (i * 3) + 1] = set[setKi] * simRand(0.5, 1.5);
+		set[setGsGains + (i * 3) + 2] = set[setKd] * simRand(0.5, 1.5);
+	}
+
+	do
+	{
+		target = pos + ((simRand(0, 1) < 0.5)? -1.0 : 1.0) * simRand(2.0, 150.0);
+	} while (abs(target) > SIM_POS_MAX);
+	set[setTarget] = target;
+}
+
+/*******************************************************************************
+
+Stops whatever we were doing, and starts the move in "set" from "count"
+
+ *******************************************************************************/
+void simStartMove(const float * set, int count)
+{
+	_position = count;
+	_lastEdge_tick = simTick;
+	appPidControl::Stop();
+
+	appPidControl::pidSettings.Period = set[setPeriod];
+	appPidControl::pidSettings.Kp = set[setKp];
+	appPidControl::pidSettings.Ki = set[setKi];
+	appPidControl::pidSettings.Kd = set[setKd];
+	appPidControl::pidSettings.MaxAccel = set[setMaxAccel];
+	appPidControl::pidSettings.MaxSpeed = set[setMaxSpeed];
+	appPidControl::pidSettings.MinSpeed = set[setMinSpeed];
+	appPidControl::pidSettings.MaxJerk = set[setMaxJerk];
+	appPidControl::pidSettings.Kff = set[setKff];
+	appPidControl::pidSettings.Kaff = set[setKaff];
+
+	appPidControl::gainSchedule.Enable = (set[setGsEnable] != 0.0);
+	for (int i = 0; i < GS_POINTS; i++)
+	{
+		appPidControl::gainSchedule.Speed[i] = set[setGsSpeed + i];
+		for (int dir = GS_DIR_POS; dir <= GS_DIR_NEG; dir++)
+		{
+			const float * gains = &set[setGsGains + (((dir * GS_POINTS) + i) * 3)];
+			appPidControl::gainSchedule.Gains[dir][i].Kp = gains[0];
+			appPidControl::gainSchedule.Gains[dir][i].Ki = gains[1];
+			appPidControl::gainSchedule.Gains[dir][i].Kd = gains[2];
+		}
+	}
+
+	appPidControl::BrakeTableBuild();
+	appPidControl::UpdateSettings();
+	appPidControl::GotoPos(set[setTarget], false);
+}
+
+/*******************************************************************************
+
+Restores the state a control step starts from (recorded from the float step)
+
+ *******************************************************************************/
+void simSetState(float speed, float intError, float error, float feedFwd)
+{
+	appPidControl::pidSettings.Speed = speed;
+	appPidControl::pidSettings.intError = intError;
+	appPidControl::pidSettings.error = error;
+	pidFeedFwd = feedFwd;
+#ifdef PID_FIXED_POINT
+	pidFixed.Speed = stdUtils::q16FromFloat(speed);
+	pidFixed.intError = stdUtils::q16FromFloat(intError);
+	pidFixed.error = stdUtils::q16FromFloat(error);
+	pidFixed.FeedFwd = stdUtils::q16FromFloat(feedFwd);
+#endif /* PID_FIXED_POINT */
+}
+
+/*******************************************************************************
+
+Runs one control step "elapsed" ticks after the last one
+
+ *******************************************************************************/
+void simStep(unsigned int elapsed)
+{
+	simSetClock(simTick + elapsed);
+	appPidControl::ctlStats.LastTick = simTick - elapsed;
+	timerUtils::ctlTick.Pending = 1;
+	appPidControl::PID_Process();
+}
+
+/*******************************************************************************
+
+Records SIM_MOVES closed loop moves with a control period of "period" (s)
+
+ *******************************************************************************/
+int simRecord(float period)
+{
+float set[setCount];
+double pos = 0.0;		/* deg, where the motor really is... */
+double vel;				/* ...and how fast it is going (deg/s) */
+unsigned int periodTicks = (unsigned int)((period * 1000000.0 * TICKS_PER_US) + 0.5);
+unsigned int elapsed;
+unsigned int moveStart;
+unsigned int t;
+unsigned int sub;
+int count;
+int steps = 0;
+
+	simSetClock(0);
+	appPidControl::Init();
+
+	for (int move = 0; move < SIM_MOVES; move++)
+	{
+		//Every move starts from rest
+		count = _position;
+		pos = count * MOTOR_POS_INCREMENT_DEG;
+		vel = 0.0;
+
+		simPickMove(set, period, pos);
+		printf("M,%u,%d", simTick, count);
+		for (int i = 0; i < setCount; i++)
+			printf(",%a", set[i]);
+		printf("\n");
+		simStartMove(set, count);
+		moveStart = simTick;
+
+		while ((appPidControl::pidSettings.Enable) &&
+				(((float)(simTick - moveStart)) < (SIM_MOVE_TIME_MAX * 1000000.0 * TICKS_PER_US)))
+		{
+			elapsed = periodTicks + (int)(periodTicks * simRand(-SIM_JITTER, SIM_JITTER));
+
+			//Move the motor along to the time of this step...
+			for (t = 0; t < elapsed; t += sub)
+			{
+				sub = (elapsed - t < SIM_SUBSTEP_TICKS)? elapsed - t : SIM_SUBSTEP_TICKS;
+				vel += (devMotorControl::GetSpeed_DAC() - vel) *
+						(1.0 - exp(-(sub / (1000000.0 * TICKS_PER_US)) / SIM_PLANT_TAU));
+				pos += vel * (sub / (1000000.0 * TICKS_PER_US));
+				count = (int)floor((pos / MOTOR_POS_INCREMENT_DEG) + 0.5);
+				if (count != _position)
+				{
+					_position = count;
+					_lastEdge_tick = simTick + t + sub;
+				}
+			}
+
+			printf("S,%u,%d,%u,%a,%a,%a,%a", elapsed, _position, _lastEdge_tick,
+					appPidControl::pidSettings.Speed, appPidControl::pidSettings.intError,
+					appPidControl::pidSettings.error, pidFeedFwd);
+			simStep(elapsed);
+			printf(",%d,%a\n", simDacLevel(), appPidControl::pidSettings.Speed);
+			steps++;
+		}
+	}
+
+	fprintf(stderr, "Recorded %d moves (%d steps) at %gs\n", SIM_MOVES, steps, period);
+	return 0;
+}
+
+/*******************************************************************************
+
+Replays the recording on stdin, one step at a time
+
+ *******************************************************************************/
+int simReplay(void)
+{
+char line[2048];
+char *field;
+float set[setCount];
+unsigned int tick;
+unsigned int elapsed;
+unsigned int lastEdge;
+int count;
+float state[4];
+
+	simSetClock(0);
+	appPidControl::Init();
+
+	while (fgets(line, sizeof(line), stdin))
+	{
+		if (line[0] == 'M')
+		{
+			tick = strtoul(&line[2], &field, 10);
+			count = strtol(field + 1, &field, 10);
+			for (int i = 0; i < setCount; i++)
+				set[i] = strtod(field + 1, &field);
+			simSetClock(tick);
+			simStartMove(set, count);
+			printf("M\n");
+		}
+		else if (line[0] == 'S')
+		{
+			elapsed = strtoul(&line[2], &field, 10);
+			_position = strtol(field + 1, &field, 10);
+			lastEdge = strtoul(field + 1, &field, 10);
+			_lastEdge_tick = lastEdge;
+			for (int i = 0; i < 4; i++)
+				state[i] = strtod(field + 1, &field);
+			simSetState(state[0], state[1], state[2], state[3]);
+			simStep(elapsed);
+			printf("%d,%a\n", simDacLevel(), appPidControl::pidSettings.Speed);
+		}
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+
+Reads the next line of "f" into "line", false if there is none
+
+ *******************************************************************************/
+bool simReadLine(FILE * f, char * line, int size)
+{
+	return (fgets(line, size, f) != NULL);
+}
+
+/*******************************************************************************
+
+Compares the float and fixed point replays of a recording (see the top)
+
+ *******************************************************************************/
+int simCompare(const char * recName, const char * fltName, const char * fixName)
+{
+FILE *rec = fopen(recName, "r");
+FILE *flt = fopen(fltName, "r");
+FILE *fix = fopen(fixName, "r");
+char recLine[2048];
+char fltLine[256];
+char fixLine[256];
+char *field;
+int recDac, fltDac, fixDac;
+float recSpd, fltSpd, fixSpd;
+int steps = 0;
+int snapped = 0;
+int mismatch = 0;
+int failed = 0;
+int dacDiffMax = 0;
+float spdDiffMax = 0.0;
+
+	if ((!rec) || (!flt) || (!fix))
+	{
+		fprintf(stderr, "Cannot open %s, %s or %s\n", recName, fltName, fixName);
+		return 1;
+	}
+
+	while (simReadLine(rec, recLine, sizeof(recLine)))
+	{
+		if ((!simReadLine(flt, fltLine, sizeof(fltLine))) || (!simReadLine(fix, fixLine, sizeof(fixLine))))
+		{
+			fprintf(stderr, "The replays are shorter than the recording\n");
+			return 1;
+		}
+		if (recLine[0] != 'S')
+			continue;
+
+		//The outputs are the last two fields of the recorded step
+		field = strrchr(recLine, ',');
+		recSpd = strtod(field + 1, NULL);
+		*field = 0;
+		recDac = strtol(strrchr(recLine, ',') + 1, NULL, 10);
+		fltDac = strtol(fltLine, &field, 10);
+		fltSpd = strtod(field + 1, NULL);
+		fixDac = strtol(fixLine, &field, 10);
+		fixSpd = strtod(field + 1, NULL);
+		steps++;
+
+		if ((fltDac != recDac) || (fltSpd != recSpd))
+			mismatch++;
+
+		if (abs(fixSpd - fltSpd) > spdDiffMax)
+			spdDiffMax = abs(fixSpd - fltSpd);
+
+		if ((abs(fltSpd) < (MOTOR_SPD_ABS_MIN + SNAP_MARGIN)) || (abs(fixSpd) < (MOTOR_SPD_ABS_MIN + SNAP_MARGIN)))
+		{
+			snapped++;
+			continue;
+		}
+
+		if (abs(fixDac - fltDac) > dacDiffMax)
+			dacDiffMax = abs(fixDac - fltDac);
+		if (abs(fixDac - fltDac) > DAC_DIFF_MAX)
+		{
+			if (failed < 10)
+				fprintf(stderr, "Step %d: float DAC %d (%g deg/s), fixed DAC %d (%g deg/s)\n",
+						steps, fltDac, fltSpd, fixDac, fixSpd);
+			failed++;
+		}
+	}
+
+	printf("%s: %d steps (%d below MinSpd), max DAC diff %d, max speed diff %g deg/s\n",
+			recName, steps, snapped, dacDiffMax, spdDiffMax);
+	if (mismatch)
+		printf("FAIL: %d steps of the float replay differ from the recording\n", mismatch);
+	if (failed)
+		printf("FAIL: %d steps more than %d DAC level(s) out\n", failed, DAC_DIFF_MAX);
+
+	return ((mismatch) || (failed) || (steps == 0))? 1 : 0;
+}
+
+/*******************************************************************************
+
+pid_float record <period> > rec.csv
+pid_xxx replay < rec.csv > xxx.csv
+pid_float compare rec.csv float.csv q16.csv
+
+ *******************************************************************************/
+int main(int argc, char ** argv)
+{
+	if ((argc == 3) && (strcmp(argv[1], "record") == 0))
+		return simRecord(atof(argv[2]));
+
+	if ((argc == 2) && (strcmp(argv[1], "replay") == 0))
+		return simReplay();
+
+	if ((argc == 5) && (strcmp(argv[1], "compare") == 0))
+		return simCompare(argv[2], argv[3], argv[4]);
+
+	fprintf(stderr, "usage: %s record <period> | replay | compare <rec> <float> <fixed>\n", argv[0]);
+	return 2;
+}
+
+/****************************** END OF FILE **********************************/
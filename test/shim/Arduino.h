@@ -0,0 +1,71 @@
+/*****************************************************************************
+
+Arduino.h (host test shim)
+
+Just enough of the Arduino core for the firmware sources to build with the
+host's g++ (see test/Makefile). The registers are plain variables and the
+pins do nothing; the test drives the tick clock and millis() itself.
+
+******************************************************************************/
+#ifndef __SHIM_ARDUINO_H__
+#define __SHIM_ARDUINO_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+/* The firmware is written for the AVR, where a long is 32 bits (and the Q16.16
+ * helpers depend on it). The system headers are all in by now, so from here on
+ * a long is 32 bits on the host as well. */
+#define long int
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 			1
+#define LOW 			0
+#define INPUT 			0
+#define OUTPUT 			1
+#define INPUT_PULLUP 	2
+#define CHANGE 			1
+#define PI 				3.14159265f
+#define SERIAL_8N1 		0x06
+#define F_CPU 			16000000L
+
+#undef abs
+#define abs(x) 			((x)>0?(x):-(x))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+void noInterrupts(void);
+void interrupts(void);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+uint8_t digitalPinToBitMask(uint8_t pin);
+uint8_t digitalPinToPort(uint8_t pin);
+volatile uint8_t *portInputRegister(uint8_t port);
+char *strlwr(char *str);
+char *strupr(char *str);
+size_t strlcat(char *dst, const char *src, size_t size);
+
+struct HardwareSerial
+{
+	void begin(unsigned long baud, uint8_t config);
+	void flush(void);
+	int available(void);
+	int read(void);
+	size_t write(uint8_t c);
+	size_t print(const char *str);
+};
+extern HardwareSerial Serial;
+
+#endif /* __SHIM_ARDUINO_H__ */
@@ -0,0 +1,10 @@
+/* avr/interrupt.h (host test shim): the ISRs are plain functions the test may call */
+#ifndef __SHIM_AVR_INTERRUPT_H__
+#define __SHIM_AVR_INTERRUPT_H__
+
+#define ISR(vector) extern "C" void vector(void)
+
+void cli(void);
+void sei(void);
+
+#endif /* __SHIM_AVR_INTERRUPT_H__ */
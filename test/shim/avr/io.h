@@ -0,0 +1,23 @@
+/* avr/io.h (host test shim): the registers the firmware touches, as variables */
+#ifndef __SHIM_AVR_IO_H__
+#define __SHIM_AVR_IO_H__
+
+#include <stdint.h>
+
+#define SHIM_REG(x) extern volatile uint8_t x;
+SHIM_REG(PIND) SHIM_REG(PINB) SHIM_REG(PINC) SHIM_REG(PORTD) SHIM_REG(PORTB) SHIM_REG(PORTC) SHIM_REG(DDRD)
+SHIM_REG(TCCR2A) SHIM_REG(TCCR2B) SHIM_REG(TIMSK2) SHIM_REG(TCNT2) SHIM_REG(OCR2A) SHIM_REG(OCR2B) SHIM_REG(ASSR) SHIM_REG(TIFR2)
+SHIM_REG(TCCR1A) SHIM_REG(TCCR1B) SHIM_REG(TCCR1C) SHIM_REG(TIMSK1) SHIM_REG(TIFR1)
+SHIM_REG(EICRA) SHIM_REG(EIMSK) SHIM_REG(EIFR) SHIM_REG(PCICR) SHIM_REG(PCMSK2) SHIM_REG(PCIFR) SHIM_REG(SREG) SHIM_REG(GTCCR)
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t ICR1;
+
+#define _BV(b) (1 << (b))
+
+enum {	TOIE2 = 0, OCIE2A = 1, OCIE2B = 2, WGM20 = 0, WGM21 = 1, WGM22 = 3, AS2 = 5, CS20 = 0, CS21 = 1, CS22 = 2, TOV2 = 0, OCF2A = 1,
+		TOIE1 = 0, TOV1 = 0, CS10 = 0, CS11 = 1, CS12 = 2, WGM10 = 0, WGM11 = 1, WGM12 = 3, WGM13 = 4, ICIE1 = 5, ICF1 = 5, ICES1 = 6, ICNC1 = 7,
+		INT0 = 0, INT1 = 1, ISC00 = 0, ISC01 = 1, ISC10 = 2, ISC11 = 3, INTF0 = 0, INTF1 = 1, PCIE2 = 2, PCINT20 = 4, PCIF2 = 2,
+		PIND2 = 2, PIND3 = 3, PIND4 = 4, PINB1 = 1, PSRASY = 1, PSRSYNC = 0, TSM = 7 };
+
+#endif /* __SHIM_AVR_IO_H__ */
@@ -0,0 +1,25 @@
+/* avr/pgmspace.h (host test shim): there is only one address space */
+#ifndef __SHIM_AVR_PGMSPACE_H__
+#define __SHIM_AVR_PGMSPACE_H__
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define _FDEV_SETUP_WRITE 2
+#define fdev_setup_stream(a, b, c, d) ((void)(a))
+
+int vfprintf_P(FILE *stream, const char *fmt, va_list ap);
+
+#endif /* __SHIM_AVR_PGMSPACE_H__ */
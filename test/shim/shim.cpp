@@ -0,0 +1,95 @@
+/*****************************************************************************
+
+shim.cpp (host test shim)
+
+The other half of Arduino.h: the registers, the Arduino core functions and the
+few firmware modules (the DAC and the serial port) the control loop touches but
+that we do not build for the host. Nothing here does anything, except that the
+DAC remembers its level and millis() returns whatever the test set.
+
+******************************************************************************/
+#include "Arduino.h"
+#include "halTLC5615.h"
+#include "devComms.h"
+
+/******************************************************************************
+The registers
+******************************************************************************/
+volatile uint8_t PIND, PINB, PINC, PORTD, PORTB, PORTC, DDRD;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TCNT2, OCR2A, OCR2B, ASSR, TIFR2;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+volatile uint8_t EICRA, EIMSK, EIFR, PCICR, PCMSK2, PCIFR, SREG, GTCCR;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint16_t ICR1;
+
+/******************************************************************************
+The Arduino core
+******************************************************************************/
+HardwareSerial Serial;
+unsigned long shimMillis;		/* What millis() returns (set by the test) */
+
+void noInterrupts(void) {}
+void interrupts(void) {}
+void cli(void) {}
+void sei(void) {}
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+unsigned long millis(void) { return shimMillis; }
+unsigned long micros(void) { return shimMillis * 1000; }
+void delay(unsigned long ms) {}
+uint8_t digitalPinToBitMask(uint8_t pin) { return 1 << (pin & 7); }
+uint8_t digitalPinToPort(uint8_t pin) { return 0; }
+volatile uint8_t *portInputRegister(uint8_t port) { return &PIND; }
+
+char *strlwr(char *str)
+{
+	for (char *c = str; *c; c++)
+		*c = tolower(*c);
+	return str;
+}
+
+char *strupr(char *str)
+{
+	for (char *c = str; *c; c++)
+		*c = toupper(*c);
+	return str;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+size_t len = strlen(dst);
+
+	if (len < size)
+		snprintf(dst + len, size - len, "%s", src);
+	return len + strlen(src);
+}
+
+int vfprintf_P(FILE *stream, const char *fmt, va_list ap) { return 0; }
+
+void HardwareSerial::begin(unsigned long baud, uint8_t config) {}
+void HardwareSerial::flush(void) {}
+int HardwareSerial::available(void) { return 0; }
+int HardwareSerial::read(void) { return -1; }
+size_t HardwareSerial::write(uint8_t c) { return 1; }
+size_t HardwareSerial::print(const char *str) { return strlen(str); }
+
+/******************************************************************************
+The firmware modules we do not build
+******************************************************************************/
+unsigned int shimDacLevel;		/* The last level set on the DAC */
+
+bool halTLC5615::Init(void) { return true; }
+unsigned int halTLC5615::SetLevel(unsigned int level) { return shimDacLevel = level; }
+unsigned int halTLC5615::GetLevel_abs(void) { return shimDacLevel; }
+
+void devComms::_SerialPrintf(const char *fmt, ...) {}
+void devComms::DoNothing(int traceflags, const char *fmt, ...) {}
+
+/* stdUtils::FreeRam() takes the address of the heap pointers of avr-libc */
+namespace stdUtils
+{
+	int __heap_start, *__brkval;
+}
+
+/****************************** END OF FILE **********************************/
@@ -0,0 +1,9 @@
+/* util/atomic.h (host test shim): nothing interrupts us on the host */
+#ifndef __SHIM_UTIL_ATOMIC_H__
+#define __SHIM_UTIL_ATOMIC_H__
+
+#define ATOMIC_RESTORESTATE	0
+#define ATOMIC_FORCEON		1
+#define ATOMIC_BLOCK(type) for (int __atomicOnce = 1; __atomicOnce; __atomicOnce = 0)
+
+#endif /* __SHIM_UTIL_ATOMIC_H__ */
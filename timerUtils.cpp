@@ -9,8 +9,21 @@ Compiler:	Arduino AVR Compiler
 
 This implements timers which has to be polled to check for expiry.
 The timer will act as a one-shot timer in normal operation.
-To make the timer behave as a recurring timer, reload the interval and start
-the timer once it has expired (using TimerStart()).
+To make the timer behave as a recurring timer, re-arm it once it has expired:
+msTimerNext() keeps a fixed phase, msTimerReset() counts again from now.
+
+Timers can also be added (msTimerAdd) to a list with a callback function. The
+list is kept sorted on expiry time, so msTimerService() (called once per pass
+of the main loop) reads the time once and only has to look at the head of the
+list. These timers are periodic and keep a fixed phase: they are re-armed
+from their previous expiry time and not from "now".
+
+The Task Scheduler (ST_TASK type)
+The main loop hands a static table of tasks (in priority order, highest
+first) to taskInit() and then calls taskService() forever. Every task is run
+once per pass and timed; the longest run and the number of runs over the
+task's budget are kept for every task. Tasks must be cooperative: do a bounded
+amount of work and return.
 
 The General Timer (ST_MS_TIMER type) - 1 kHz granularity
 The general Timers enables the program to create a downcounter with a
@@ -38,17 +51,65 @@ local defines
 /*******************************************************************************
 local variables
  *******************************************************************************/
-unsigned long timerUtils::time_units;
 void (*timerUtils::func)();
-volatile unsigned long timerUtils::count;
-volatile char timerUtils::overflowing;
-volatile unsigned int timerUtils::tcnt2;
+
+volatile unsigned int _tickOverflows;	/* The upper 16 bits of the tick count */
+
+ST_US_TICK timerUtils::ctlTick;
+ST_US_TICK timerUtils::velTick;
+
+ST_TASK * _taskTable = NULL;		/* The task table (owned by the main loop) */
+byte _taskCnt = 0;
+
+ST_MS_TIMER * _msTimerList = NULL;	/* Callback timers, sorted by msExpire */
+unsigned long _msNow;				/* The time of the last msTimerService() pass */
 
 /*******************************************************************************
 local functions
  *******************************************************************************/
 /*******************************************************************************
 
+Returns true if "now" is at or beyond "expire", even if millis() has wrapped
+in between (as long as they are less than ~24 days apart).
+
+ *******************************************************************************/
+static inline bool msTimeReached(unsigned long now, unsigned long expire)
+{
+	return ((long)(now - expire) >= 0);
+}
+
+/*******************************************************************************
+
+Moves the expiry time of a periodic timer on by one period (fixed phase). If
+we have fallen more than a full period behind, we do not try to catch up on
+every missed expiry, we just start again from "now".
+
+ *******************************************************************************/
+static void msTimerRearm(ST_MS_TIMER *t, unsigned long now)
+{
+	t->msExpire += t->msPeriod;
+	if (msTimeReached(now, t->msExpire))
+		t->msExpire = now + t->msPeriod;
+}
+
+/*******************************************************************************
+
+Inserts a timer into the callback list, sorted by expiry time
+
+ *******************************************************************************/
+static void msTimerInsert(ST_MS_TIMER *t)
+{
+ST_MS_TIMER **link = &_msTimerList;
+
+	//Timers with the same expiry time stay in the order they were inserted
+	while ((*link) && (msTimeReached(t->msExpire, (*link)->msExpire)))
+		link = &((*link)->Next);
+
+	t->Next = *link;
+	*link = t;
+}
+/*******************************************************************************
+
 Constructor - Initializes the timers.
 
  *******************************************************************************/
@@ -62,89 +123,165 @@ Constructor - Initializes the timers.
 
 /*******************************************************************************
 
-Sets the timers interval and starts it.
+Sets up Timer2 to call "f" every US_TIMER_PERIOD_US (from interrupt context).
+"f" may be NULL if we only want the control tick (see usTickStart).
+
+The timer runs in CTC mode: the hardware clears TCNT2 when it matches OCR2A, so
+the period does not depend on how long it takes us to get to the ISR (as it
+did when we reloaded TCNT2 from the overflow ISR). The prescaler and OCR2A are
+worked out at compile time (see timerUtils.h).
+
+ *******************************************************************************/
+void timerUtils::usTimerInit(void (*f)()) {
+	func = f;
+
+	TIMSK2 &= ~((1<<TOIE2) | (1<<OCIE2A) | (1<<OCIE2B));
+	ASSR &= ~(1<<AS2);
+
+	TCCR2A = (1<<WGM21);			// CTC mode, TOP = OCR2A
+	TCCR2B = US_TIMER_CS_BITS;
+	OCR2A = US_TIMER_OCR;
+	//	200us @ 16MHz:	prescaler 32, OCR2A = 3200/32 - 1 = 99
+}
+
+void timerUtils::usTimerStart() {
+	TCNT2 = 0;
+	TIFR2 = (1<<OCF2A);
+	TIMSK2 |= (1<<OCIE2A);
+}
+
+void timerUtils::usTimerStop() {
+	TIMSK2 &= ~(1<<OCIE2A);
+}
+
+/*******************************************************************************
+
+Returns the period (in ns) we actually get from the Timer2 settings, which may
+differ slightly from US_TIMER_PERIOD_US if it does not divide evenly.
 
  *******************************************************************************/
+unsigned long timerUtils::usTimerPeriod_ns(void) {
+	return US_TIMER_ACTUAL_NS;
+}
 
-//void timerUtils::usTimerInit(unsigned long ms, void (*f)()) {
-//	timerUtils::usTimerInit(ms, 0.001, f);
-//}
 /*******************************************************************************
 
- * @param resolution
- *   0.001 implies a 1 ms (1kHz) resolution.
- *   0.0005 implies a 0.5 ms or 500us  (2kHz) resolution.
- *   0.000005 implies a 5us  (200kHz) resolution.
- *   For a 9600 baud transmission, the bit period is 104.17us, i.e. 0.00010417
+Starts the tick "t": every "period_us" (rounded to a multiple of
+US_TIMER_PERIOD_US) the Timer2 ISR flags a tick, to be taken by usTickTake().
+This gives a loop an exact rate, no matter how long the rest of the main loop
+takes (as long as it is not longer than a period, on average). There is one
+for the control step (ctlTick) and one for the inner velocity loop (velTick).
 
  *******************************************************************************/
-void timerUtils::usTimerInit(unsigned long units, double resolution, void (*f)()) {
-	float prescaler = 0.0;
+void timerUtils::usTickStart(ST_US_TICK *t, unsigned long period_us) {
+	unsigned long divisor = (period_us + (US_TIMER_PERIOD_US/2)) / US_TIMER_PERIOD_US;
+
+	noInterrupts();
+	t->Divisor = (divisor > 0)? ((divisor < 0xFFFF)? divisor : 0xFFFF) : 1;
+	t->DivCnt = 0;
+	t->Pending = 0;
+	interrupts();
+}
 
-	if (units == 0)
-		time_units = 1;
-	else
-		time_units = units;
+void timerUtils::usTickStop(ST_US_TICK *t) {
+	noInterrupts();
+	t->Divisor = 0;
+	t->Pending = 0;
+	interrupts();
+}
 
-	func = f;
+/*******************************************************************************
 
-	TIMSK2 &= ~(1<<TOIE2);
-	TCCR2A &= ~((1<<WGM21) | (1<<WGM20));
-	TCCR2B &= ~(1<<WGM22);
-	ASSR &= ~(1<<AS2);
-	TIMSK2 &= ~(1<<OCIE2A);
+Takes all the pending ticks of "t".
+Returns the number of ticks taken: 0 means it is not time yet, more than 1
+means we have missed (overrun) some.
 
-	if ((F_CPU >= 1000000UL) && (F_CPU <= 16000000UL)) {	// prescaler set to 64
-		TCCR2B |= (1<<CS22);
-		TCCR2B &= ~((1<<CS21) | (1<<CS20));
-		prescaler = 64.0;
-	} else if (F_CPU < 1000000UL) {	// prescaler set to 8
-		TCCR2B |= (1<<CS21);
-		TCCR2B &= ~((1<<CS22) | (1<<CS20));
-		prescaler = 8.0;
-	} else { // F_CPU > 16Mhz, prescaler set to 128
-		TCCR2B |= ((1<<CS22) | (1<<CS20));
-		TCCR2B &= ~(1<<CS21);
-		prescaler = 128.0;
-	}
+ *******************************************************************************/
+byte timerUtils::usTickTake(ST_US_TICK *t) {
+	byte pending;
 
-	tcnt2 = 256 - (int)((float)F_CPU * resolution / prescaler);
-	//	9600 baud: 		tcnt2 = 256 - (int)((float)16000000 * 0.00010417 / 64); = 229.9575 = 229
-	//	19200 baud: 	tcnt2 = 256 - (int)((float)16000000 * 0.000052083 / 64); = 242.97925 = 242
-	//	38400 baud: 	tcnt2 = 256 - (int)((float)16000000 * 0.0000260417 / 64); = 249.489575 = 249
-	//	57600 baud: 	tcnt2 = 256 - (int)((float)16000000 * 0.000017361 / 64); = 251.65975 = 251
-	//	115200 baud:	tcnt2 = 256 - (int)((float)16000000 * 0.0000086806 / 64); = 253.82985 = 253
+	noInterrupts();
+	pending = t->Pending;
+	t->Pending = 0;
+	interrupts();
 
+	return pending;
 }
 
-void timerUtils::usTimerStart() {
-	count = 0;
-	overflowing = 0;
-	TCNT2 = tcnt2;
-	TIMSK2 |= (1<<TOIE2);
+/*******************************************************************************
+
+Counts one Timer2 period towards the next tick of "t" (from the ISR)
+
+ *******************************************************************************/
+static inline void usTickCount(ST_US_TICK *t) {
+	if ((t->Divisor) && (++t->DivCnt >= t->Divisor)) {
+		t->DivCnt = 0;
+		if (t->Pending < 0xFF)
+			t->Pending++;
+	}
 }
 
-void timerUtils::usTimerStop() {
-	TIMSK2 &= ~(1<<TOIE2);
+ISR(TIMER2_COMPA_vect) {
+	if (timerUtils::func)
+		(*timerUtils::func)();
+
+	usTickCount(&timerUtils::ctlTick);
+	usTickCount(&timerUtils::velTick);
 }
 
-void timerUtils::usTimer_overflow() {
-	count += 1;
 
-	if (count >= time_units && !overflowing) {
-		overflowing = 1;
-		count = count - time_units; // subtract time_uints to catch missed overflows
-					// set to 0 if you don't want this.
-		(*func)();
-		overflowing = 0;
-	}
+/*******************************************************************************
+
+Starts Timer1 free-running (normal mode, no output compare) as the tick time
+base. Timer1 is not used by the Arduino core on the UNO (other than for
+analogWrite on pins 9 and 10, which we do not use).
+
+ *******************************************************************************/
+void timerUtils::tickTimerInit(void)
+{
+	TIMSK1 = 0;
+	TCCR1A = 0;
+	TCCR1B = (1<<CS11);		// Normal mode, prescaler set to 8
+	TCCR1C = 0;
+
+	_tickOverflows = 0;
+	TCNT1 = 0;
+	TIFR1 = (1<<TOV1);
+	TIMSK1 = (1<<TOIE1);
 }
 
-ISR(TIMER2_OVF_vect) {
-	TCNT2 = timerUtils::tcnt2;
-	timerUtils::usTimer_overflow();
+/*******************************************************************************
+
+Returns the 32 bit tick count (TICKS_PER_US ticks per micro second).
+
+Unlike micros(), this does not enable the interrupts, so it can be called from
+inside an ISR. If Timer1 has overflowed but the overflow interrupt has not been
+serviced yet (we are in an ISR or the interrupts are disabled) we account for
+it here.
+
+ *******************************************************************************/
+unsigned long timerUtils::tickNow(void)
+{
+byte oldSREG = SREG;
+unsigned int tickLow;
+unsigned int tickHigh;
+
+	cli();
+	tickLow = TCNT1;
+	tickHigh = _tickOverflows;
+
+	//An overflow is pending... and TCNT1 was read after it happened
+	if ((TIFR1 & (1<<TOV1)) && (tickLow < 0x8000))
+		tickHigh++;
+
+	SREG = oldSREG;
+
+	return ((unsigned long)tickHigh << 16) | tickLow;
 }
 
+ISR(TIMER1_OVF_vect) {
+	_tickOverflows++;
+}
 
 /*******************************************************************************
 
@@ -164,8 +301,9 @@ void timerUtils::msTimerStart(ST_MS_TIMER *t, unsigned long interval)
 
 /*******************************************************************************
 
-Sets the timers interval and starts it. In order for the timer to be maintained
-it must be added to the linked list with TimerAdd().
+Restarts the timer with the interval it was started with, counting from now
+(millis()). However late this is called, the timer runs a full interval from
+here, so this is the one to use as a watchdog.
 
  *******************************************************************************/
 bool timerUtils::msTimerReset(ST_MS_TIMER *t)
@@ -179,6 +317,26 @@ bool timerUtils::msTimerReset(ST_MS_TIMER *t)
 	}
 	return t->Enabled;
 }
+
+/*******************************************************************************
+
+Re-arms an expired polled timer for its next period, counting from its previous
+expiry (fixed phase), so a periodic timer does not drift with our polling
+latency. If we have fallen more than a full period behind, it counts from now
+(millis()) instead of expiring again straight away.
+
+ *******************************************************************************/
+bool timerUtils::msTimerNext(ST_MS_TIMER *t)
+{
+	if (t->msPeriod > 0)
+	{
+		t->Enabled = false;
+		msTimerRearm(t, millis());
+		t->Expired = false;
+		t->Enabled = true;
+	}
+	return t->Enabled;
+}
 /*******************************************************************************
 
 Stops the timer. DO NOT POLL A ST_MS_TIMER YOU HAVE STOPPED.
@@ -202,7 +360,8 @@ it doesn't expire.
  *******************************************************************************/
 bool timerUtils::msTimerPoll(ST_MS_TIMER *t)   //Pointer to the Timer Struct which you want to poll
 {
-	unsigned long now_ms = millis();
+	//Use the time of this pass of the main loop (see msTimerService)
+	unsigned long now_ms = _msNow;
 
 	//Is the timer enabled?
 	if (t->Enabled == false)
@@ -212,7 +371,7 @@ bool timerUtils::msTimerPoll(ST_MS_TIMER *t)   //Pointer to the Timer Struct whi
 	if (!(t->Expired))
 	{
 		//have we moved beyond the expiry time?
-		if (now_ms >= t->msExpire)
+		if (msTimeReached(now_ms, t->msExpire))
 		{
 			//NOW it has expired
 			t->Expired = true;
@@ -224,6 +383,137 @@ bool timerUtils::msTimerPoll(ST_MS_TIMER *t)   //Pointer to the Timer Struct whi
 
 /*******************************************************************************
 
+Adds a periodic timer to the callback list. The callback "f" will be called
+(from msTimerService) every "interval" ms until the timer is removed again.
+Adding a timer that is already in the list restarts it.
+
+ *******************************************************************************/
+void timerUtils::msTimerAdd(ST_MS_TIMER *t, unsigned long interval, void (*f)(void))
+{
+	timerUtils::msTimerRemove(t);
+
+	t->msPeriod = (interval > 0)? interval : 1;
+	t->msExpire = millis() + t->msPeriod;
+	t->Callback = f;
+	t->Expired = false;
+	t->Enabled = true;
+	msTimerInsert(t);
+}
+
+/*******************************************************************************
+
+Removes a timer from the callback list (it is safe to call this for a timer
+that is not in the list, or from its own callback).
+
+ *******************************************************************************/
+void timerUtils::msTimerRemove(ST_MS_TIMER *t)
+{
+ST_MS_TIMER **link = &_msTimerList;
+
+	t->Enabled = false;
+	while (*link)
+	{
+		if (*link == t)
+		{
+			*link = t->Next;
+			break;
+		}
+		link = &((*link)->Next);
+	}
+	t->Next = NULL;
+}
+
+/*******************************************************************************
+
+Call this once per pass of the main loop. It reads the time once (for this
+function as well as every msTimerPoll in this pass) and calls the callbacks of
+all the timers in the list which have expired.
+
+ *******************************************************************************/
+void timerUtils::msTimerService(void)
+{
+ST_MS_TIMER *t;
+
+	_msNow = millis();
+
+	while ((_msTimerList) && (msTimeReached(_msNow, _msTimerList->msExpire)))
+	{
+		//Take it off the front, re-arm it and put it back in its new place
+		t = _msTimerList;
+		_msTimerList = t->Next;
+		msTimerRearm(t, _msNow);
+		msTimerInsert(t);
+
+		(*t->Callback)();
+	}
+}
+
+/*******************************************************************************
+
+Sets the table of tasks for taskService() to run. The table must be sorted in
+priority order (highest first) and must stay in memory.
+
+ *******************************************************************************/
+void timerUtils::taskInit(ST_TASK *tasks, byte cnt)
+{
+	_taskTable = tasks;
+	_taskCnt = cnt;
+	timerUtils::taskStatsReset();
+}
+
+/*******************************************************************************
+
+Runs every task in the table once, in priority order, and keeps track of how
+long each one took.
+
+ *******************************************************************************/
+void timerUtils::taskService(void)
+{
+ST_TASK *t;
+unsigned long start_tick;
+unsigned long run_us;
+
+	for (byte i = 0; i < _taskCnt; i++)
+	{
+		t = &_taskTable[i];
+
+		start_tick = timerUtils::tickNow();
+		(*t->Task)();
+		run_us = (timerUtils::tickNow() - start_tick) / TICKS_PER_US;
+
+		if (run_us > t->MaxRun_us)
+			t->MaxRun_us = (run_us < 0xFFFF)? run_us : 0xFFFF;
+		if ((run_us > t->Budget_us) && (t->Overruns < 0xFFFF))
+			t->Overruns++;
+	}
+}
+
+/*******************************************************************************
+
+Clears the run time statistics of all the tasks
+
+ *******************************************************************************/
+void timerUtils::taskStatsReset(void)
+{
+	for (byte i = 0; i < _taskCnt; i++)
+	{
+		_taskTable[i].MaxRun_us = 0;
+		_taskTable[i].Overruns = 0;
+	}
+}
+
+byte timerUtils::taskCount(void)
+{
+	return _taskCnt;
+}
+
+ST_TASK * timerUtils::taskGet(byte index)
+{
+	return (index < _taskCnt)? &_taskTable[index] : NULL;
+}
+
+/*******************************************************************************
+
 Returns true if the timer is enabled.
 
  *******************************************************************************/
@@ -23,6 +23,47 @@ definitions
 #define EXT extern
 #endif /* __NOT_EXTERN__ */
 
+/* Timer2 runs in CTC mode and calls the usTimer callback every
+ * US_TIMER_PERIOD_US. The prescaler and compare value are worked out here at
+ * compile time (OCR2A must fit in 8 bits, so we pick the smallest prescaler
+ * that allows it). */
+#define US_TIMER_PERIOD_US		200
+#define US_TIMER_CYCLES			((F_CPU/1000000UL) * US_TIMER_PERIOD_US)
+
+#if (US_TIMER_CYCLES <= 256UL)
+	#define US_TIMER_PRESCALER	1
+	#define US_TIMER_CS_BITS	(1<<CS20)
+#elif (US_TIMER_CYCLES <= (256UL * 8))
+	#define US_TIMER_PRESCALER	8
+	#define US_TIMER_CS_BITS	(1<<CS21)
+#elif (US_TIMER_CYCLES <= (256UL * 32))
+	#define US_TIMER_PRESCALER	32
+	#define US_TIMER_CS_BITS	((1<<CS21) | (1<<CS20))
+#elif (US_TIMER_CYCLES <= (256UL * 64))
+	#define US_TIMER_PRESCALER	64
+	#define US_TIMER_CS_BITS	(1<<CS22)
+#elif (US_TIMER_CYCLES <= (256UL * 128))
+	#define US_TIMER_PRESCALER	128
+	#define US_TIMER_CS_BITS	((1<<CS22) | (1<<CS20))
+#elif (US_TIMER_CYCLES <= (256UL * 256))
+	#define US_TIMER_PRESCALER	256
+	#define US_TIMER_CS_BITS	((1<<CS22) | (1<<CS21))
+#elif (US_TIMER_CYCLES <= (256UL * 1024))
+	#define US_TIMER_PRESCALER	1024
+	#define US_TIMER_CS_BITS	((1<<CS22) | (1<<CS21) | (1<<CS20))
+#else
+	#error "US_TIMER_PERIOD_US is too long for Timer2"
+#endif
+
+#define US_TIMER_OCR			(((US_TIMER_CYCLES + (US_TIMER_PRESCALER/2)) / US_TIMER_PRESCALER) - 1)
+#define US_TIMER_ACTUAL_NS		(((US_TIMER_OCR + 1) * US_TIMER_PRESCALER * 1000UL) / (F_CPU/1000000UL))
+
+/* Timer1 free-runs as our high resolution time base ("ticks"). With a
+ * prescaler of 8 we have 0.5us ticks at 16MHz and the 32 bit tick count
+ * (extended by the overflow interrupt) rolls over every ~35 minutes. */
+#define TICK_TIMER_PRESCALER	8
+#define TICKS_PER_US			(F_CPU/(1000000UL * TICK_TIMER_PRESCALER))
+
 /******************************************************************************
 Macros
 ******************************************************************************/
@@ -31,14 +72,32 @@ Macros
 Struct & Unions
 ******************************************************************************/
 // structs
-typedef struct
+typedef struct ST_MS_TIMER
 {
   unsigned long msExpire;   // 1ms ~ 49 days.
   unsigned long msPeriod;   // 1ms ~ 49 days.
   bool Enabled;
   bool Expired;
+  void (*Callback)(void);   // Only used for timers added with msTimerAdd()
+  struct ST_MS_TIMER * Next; // ...which are kept in a list, sorted by msExpire
 } ST_MS_TIMER;
 
+typedef struct
+{
+  volatile unsigned int Divisor;  // A tick every this many Timer2 periods (0 = stopped)
+  volatile unsigned int DivCnt;
+  volatile byte Pending;          // Ticks not yet taken by usTickTake()
+} ST_US_TICK;
+
+typedef struct
+{
+  const char * Name;
+  void (*Task)(void);
+  unsigned int Budget_us;   // How long the task may run for (per call)
+  unsigned int MaxRun_us;   // The longest it has taken (per call)
+  unsigned int Overruns;    // Number of calls that took longer than Budget_us
+} ST_TASK;
+
 /******************************************************************************
 variables
 ******************************************************************************/
@@ -57,21 +116,35 @@ namespace timerUtils
     void msTimerStart(ST_MS_TIMER *t, unsigned long interval);
     void msTimerStop(ST_MS_TIMER *t);
     bool msTimerReset(ST_MS_TIMER *t);
+    bool msTimerNext(ST_MS_TIMER *t);
     bool msTimerPoll(ST_MS_TIMER *t);
     bool msTimerEnabled(ST_MS_TIMER *t);
+    void msTimerAdd(ST_MS_TIMER *t, unsigned long interval, void (*f)(void));
+    void msTimerRemove(ST_MS_TIMER *t);
+    void msTimerService(void);
+
+    void taskInit(ST_TASK *tasks, byte cnt);
+    void taskService(void);
+    void taskStatsReset(void);
+    byte taskCount(void);
+    ST_TASK * taskGet(byte index);
     unsigned long SecondCount(void);
 
-//    void usTimerInit(unsigned long, void (*f)());
-    void usTimerInit(unsigned long, double, void (*f)());
+    void usTimerInit(void (*f)());
     void usTimerStart();
     void usTimerStop();
-	void usTimer_overflow();
+    unsigned long usTimerPeriod_ns(void);
+
+    void usTickStart(ST_US_TICK *t, unsigned long period_us);
+    void usTickStop(ST_US_TICK *t);
+    byte usTickTake(ST_US_TICK *t);
+
+	void tickTimerInit(void);
+	unsigned long tickNow(void);
 
-	extern unsigned long time_units;
 	extern void (*func)();
-	extern volatile unsigned long count;
-	extern volatile char overflowing;
-	extern volatile unsigned int tcnt2;
+	extern ST_US_TICK ctlTick;	// The PID control step
+	extern ST_US_TICK velTick;	// The (faster) inner velocity loop
 };
 
 